@@ -11,13 +11,40 @@ std::tuple<double, double, double> Camera::State() const {
 }
 
 void Camera::MoveTo(double distance, double theta, double phi) {
+    if (distance == this->distance && theta == this->theta && phi == this->phi) {
+        return;
+    }
+
     this->distance = distance;
     this->theta = theta;
     this->phi = phi;
+    version++;
 }
 
 void Camera::PointAt(Vector3 target) {
+    if (target.X == this->target.X && target.Y == this->target.Y && target.Z == this->target.Z) {
+        return;
+    }
+
     this->target = target;
+    version++;
+}
+
+void Camera::SetFieldOfView(double fov) {
+    if (fov == this->fov) {
+        return;
+    }
+
+    this->fov = fov;
+    version++;
+}
+
+uint64_t Camera::Version() const {
+    return version;
+}
+
+Vector3 Camera::Position() const {
+    return Vector3::Add(target, RelativePosition());
 }
 
 Matrix Camera::ViewTransform(double aspect_ratio) const {
@@ -27,11 +54,20 @@ Matrix Camera::ViewTransform(double aspect_ratio) const {
     return projection_matrix * view_matrix;
 }
 
+double Camera::PixelsPerUnit(double distance, double screen_height) const {
+    // The projection maps y / z = tan(fov / 2) / 2 to the top of the screen
+    return screen_height / (std::tan(fov * 0.5) * distance);
+}
+
+Vector3 Camera::RelativePosition() const {
+    double rho = distance * std::cos(phi);
+    return Vector3(rho * std::cos(theta), rho * std::sin(theta), distance * std::sin(phi));
+}
+
 Matrix Camera::LookAtLH() const {
     Vector3 x_axis, y_axis, z_axis;
 
-    double rho = distance * std::cos(phi);
-    Vector3 relative_position(rho * std::cos(theta), rho * std::sin(theta), distance * std::sin(phi));
+    Vector3 relative_position = RelativePosition();
     Vector3 absolute_position = Vector3::Add(target, relative_position);
 
     Vector3 up = Vector3(0.0, 0.0, 1.0);
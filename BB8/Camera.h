@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <tuple>
 
 #include "Color.h"
@@ -18,6 +19,8 @@ private:
 
     Vector3 target;
 
+    uint64_t version = 0;
+
 public:
     Camera();
 
@@ -25,9 +28,25 @@ public:
     void MoveTo(double distance, double theta, double phi);
     void PointAt(Vector3 target);
 
+    // Vertical angle the view spans, in radians
+    void SetFieldOfView(double fov);
+
+    // Changes whenever the view does, so what's drawn from it can be kept
+    uint64_t Version() const;
+
+    // Where the camera is, in world space
+    Vector3 Position() const;
+
     Matrix ViewTransform(double aspect_ratio) const;
 
+    // Pixels spanned by a unit length facing the camera at the given distance,
+    // on a screen this many pixels high
+    double PixelsPerUnit(double distance, double screen_height) const;
+
 private:
+    // Position relative to the target
+    Vector3 RelativePosition() const;
+
     Matrix LookAtLH() const;
     Matrix PerspectiveFovLH(double aspect_ratio) const;
 };
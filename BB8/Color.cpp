@@ -6,3 +6,11 @@ Color::Color(double blue, double green, double red, double alpha)
     : Blue(blue), Green(green), Red(red), Alpha(alpha) {}
 
 Color::Color() : Color(0.0, 0.0, 0.0, 1.0) {}
+
+uint32_t Color::Packed() const {
+    auto channel = [](double value) {
+        return uint32_t(uint8_t(std::min(1.0, std::max(0.0, value)) * 255));
+    };
+
+    return channel(Alpha * Blue) | channel(Alpha * Green) << 8 | channel(Alpha * Red) << 16 | channel(Alpha) << 24;
+}
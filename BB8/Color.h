@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include "Vector3.h"
 
 class Color {
@@ -8,4 +10,8 @@ public:
     
     Color();
     Color(double blue, double green, double red, double alpha);
+
+    // One byte per channel in BGRA order from the lowest, as RenderDevice
+    // stores pixels, with the color premultiplied by alpha
+    uint32_t Packed() const;
 };
@@ -0,0 +1,61 @@
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+
+namespace {
+
+bool os_saves_state(unsigned long long mask) {
+    int info[4];
+    __cpuid(info, 1);
+
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    return osxsave && (_xgetbv(0) & mask) == mask;
+}
+
+bool extended_feature(int bit) {
+    int info[4];
+    __cpuid(info, 0);
+
+    if (info[0] < 7) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << bit)) != 0;
+}
+
+}
+
+bool CpuFeatures::AVX2() {
+    // XMM and YMM state
+    return os_saves_state(0x6) && extended_feature(5);
+}
+
+bool CpuFeatures::AVX512() {
+    // XMM, YMM, opmask and ZMM state
+    return os_saves_state(0xE6) && extended_feature(16);
+}
+
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+
+bool CpuFeatures::AVX2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+bool CpuFeatures::AVX512() {
+    return __builtin_cpu_supports("avx512f");
+}
+
+#else
+
+bool CpuFeatures::AVX2() {
+    return false;
+}
+
+bool CpuFeatures::AVX512() {
+    return false;
+}
+
+#endif
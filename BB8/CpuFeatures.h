@@ -0,0 +1,10 @@
+#pragma once
+
+// Runtime detection of optional instruction sets, for dispatching to kernels
+// compiled with wider vector extensions than the rest of the program
+class CpuFeatures
+{
+public:
+    static bool AVX2();
+    static bool AVX512();
+};
@@ -0,0 +1,186 @@
+#include "Ensemble.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+
+#include "Gearbox.h"
+#include "Simulation.h"
+#include "SimulationBatch.h"
+
+Ensemble::Ensemble(double time_step, double duration, double sample_interval)
+    : time_step(time_step), duration(duration), sample_interval(sample_interval), last_wall_time(0.0) {}
+
+void Ensemble::add(Member member) {
+    ensemble.push_back(member);
+}
+
+const std::vector<Ensemble::Member>& Ensemble::members() const {
+    return ensemble;
+}
+
+std::vector<Ensemble::Result> Ensemble::run(ThreadPool& pool) {
+    std::vector<Result> results(ensemble.size());
+
+    auto start = std::chrono::steady_clock::now();
+    pool.parallel_for(ensemble.size(), [&](size_t i) { results[i] = simulate(ensemble[i]); });
+    auto end = std::chrono::steady_clock::now();
+
+    last_wall_time = std::chrono::duration<double>(end - start).count();
+
+    return results;
+}
+
+std::vector<Ensemble::Result> Ensemble::run_batched(ThreadPool& pool, size_t batch_size) {
+    std::vector<Result> results(ensemble.size());
+    size_t batches = (ensemble.size() + batch_size - 1) / batch_size;
+
+    auto start = std::chrono::steady_clock::now();
+    pool.parallel_for(batches, [&](size_t i) {
+        simulate_batch(i * batch_size, std::min(ensemble.size(), (i + 1) * batch_size), results);
+    });
+    auto end = std::chrono::steady_clock::now();
+
+    last_wall_time = std::chrono::duration<double>(end - start).count();
+
+    return results;
+}
+
+Ensemble::Summary Ensemble::summarize(const std::vector<Result>& results) const {
+    Summary summary = {};
+    summary.members = results.size();
+    summary.wall_time = last_wall_time;
+
+    size_t stable = 0;
+
+    for (const auto& result : results) {
+        if (!result.stable) {
+            summary.unstable++;
+            continue;
+        }
+
+        summary.min_distance = stable == 0 ? result.distance : std::min(summary.min_distance, result.distance);
+        stable++;
+        summary.mean_distance += result.distance;
+        summary.max_distance = std::max(summary.max_distance, result.distance);
+        summary.mean_max_tilt_error += result.max_tilt_error;
+    }
+
+    if (stable > 0) {
+        summary.mean_distance /= stable;
+        summary.mean_max_tilt_error /= stable;
+    }
+
+    if (last_wall_time > 0.0) {
+        double steps = std::ceil(duration / time_step) * results.size();
+        summary.steps_per_second = steps / last_wall_time;
+    }
+
+    return summary;
+}
+
+Ensemble::Result Ensemble::simulate(const Member& member) const {
+    // damping matches the gearboxes used by the interactive simulation
+    Simulation simulation(member.radius, member.sphere_mass, member.pendulum_mass, member.pendulum_length,
+        time_step, Vector3(0.0, 0.0, member.radius),
+        Gearbox(member.drive_ratio, 1e-2), Gearbox(member.tilt_ratio, 2.0));
+
+    Result result = {};
+    result.stable = true;
+
+    std::vector<double> tilt_samples;
+    tilt_samples.reserve(size_t(duration / sample_interval) + 1);
+
+    Vector3 last_position = simulation.get_position();
+
+    try {
+        for (double time = 0.0; time < duration; time += sample_interval) {
+            simulation.update(std::min(sample_interval, duration - time));
+
+            Vector3 position = simulation.get_position();
+
+            if (!std::isfinite(position.X) || !std::isfinite(position.Y) || !std::isfinite(simulation.get_tilt())) {
+                result.stable = false;
+                break;
+            }
+
+            result.distance += Vector3::Length(Vector3::Subtract(position, last_position));
+            last_position = position;
+
+            tilt_samples.push_back(simulation.get_tilt());
+        }
+    } catch (const std::exception&) {
+        result.stable = false;
+    }
+
+    if (simulation.get_solver_statistics().failures > 0) {
+        result.stable = false;
+    }
+
+    result.position = simulation.get_position();
+    result.heading = simulation.get_heading();
+    result.tilt = simulation.get_tilt();
+    result.angular_velocity = simulation.get_angular_velocity();
+
+    // ignore the first half of the run while the tilt controller settles
+    for (size_t i = tilt_samples.size() / 2; i < tilt_samples.size(); i++) {
+        result.max_tilt_error = std::max(result.max_tilt_error, std::fabs(tilt_samples[i] - result.tilt));
+    }
+
+    return result;
+}
+
+void Ensemble::simulate_batch(size_t begin, size_t end, std::vector<Result>& results) const {
+    SimulationBatch batch(time_step);
+
+    for (size_t i = begin; i < end; i++) {
+        const auto& member = ensemble[i];
+        batch.add(member.radius, member.sphere_mass, member.pendulum_mass, member.pendulum_length,
+            Vector3(0.0, 0.0, member.radius), Gearbox(member.drive_ratio, 1e-2), Gearbox(member.tilt_ratio, 2.0));
+    }
+
+    size_t count = end - begin;
+    std::vector<Vector3> last_positions(count);
+    std::vector<std::vector<double>> tilt_samples(count);
+
+    for (size_t j = 0; j < count; j++) {
+        results[begin + j] = Result();
+        results[begin + j].stable = true;
+        last_positions[j] = batch.get_position(j);
+    }
+
+    for (double time = 0.0; time < duration; time += sample_interval) {
+        batch.update(std::min(sample_interval, duration - time));
+
+        for (size_t j = 0; j < count; j++) {
+            Result& result = results[begin + j];
+            Vector3 position = batch.get_position(j);
+
+            if (!std::isfinite(position.X) || !std::isfinite(position.Y) || !std::isfinite(batch.get_tilt(j))) {
+                result.stable = false;
+            }
+
+            if (result.stable) {
+                result.distance += Vector3::Length(Vector3::Subtract(position, last_positions[j]));
+                tilt_samples[j].push_back(batch.get_tilt(j));
+            }
+
+            last_positions[j] = position;
+        }
+    }
+
+    for (size_t j = 0; j < count; j++) {
+        Result& result = results[begin + j];
+
+        result.position = batch.get_position(j);
+        result.heading = batch.get_heading(j);
+        result.tilt = batch.get_tilt(j);
+        result.angular_velocity = batch.get_angular_velocity(j);
+
+        const auto& samples = tilt_samples[j];
+        for (size_t i = samples.size() / 2; i < samples.size(); i++) {
+            result.max_tilt_error = std::max(result.max_tilt_error, std::fabs(samples[i] - result.tilt));
+        }
+    }
+}
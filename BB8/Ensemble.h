@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Vector3.h"
+
+// Runs many independent simulations headless, spread across a thread pool
+class Ensemble
+{
+public:
+    class Member {
+    public:
+        double radius;
+        double sphere_mass;
+        double pendulum_mass;
+        double pendulum_length;
+        double drive_ratio;
+        double tilt_ratio;
+    };
+
+    class Result {
+    public:
+        Vector3 position;
+        double heading;
+        double tilt;
+        double angular_velocity;
+
+        // total ground distance covered
+        double distance;
+        // largest deviation of tilt from its final value after settling
+        double max_tilt_error;
+
+        // false if the simulation diverged or a coupling solve did not converge
+        bool stable;
+    };
+
+    class Summary {
+    public:
+        size_t members;
+        size_t unstable;
+
+        // over the stable members, 0 if there are none
+        double mean_distance;
+        double min_distance;
+        double max_distance;
+        double mean_max_tilt_error;
+
+        double wall_time;
+        double steps_per_second;
+    };
+
+    // sample_interval controls how often summary metrics are sampled
+    Ensemble(double time_step, double duration, double sample_interval = 0.01);
+
+    void add(Member member);
+    const std::vector<Member>& members() const;
+
+    std::vector<Result> run(ThreadPool& pool);
+
+    // Same as run, but steps groups of members in lockstep with SimulationBatch
+    std::vector<Result> run_batched(ThreadPool& pool, size_t batch_size = 64);
+
+    // summary of the most recent run
+    Summary summarize(const std::vector<Result>& results) const;
+
+private:
+    const double time_step;
+    const double duration;
+    const double sample_interval;
+
+    std::vector<Member> ensemble;
+    double last_wall_time;
+
+    Result simulate(const Member& member) const;
+    void simulate_batch(size_t begin, size_t end, std::vector<Result>& results) const;
+};
@@ -15,6 +15,9 @@ public:
 
     void update(double input_velocity);
 
+    friend class MotorAssembly;
+    friend class SimulationBatch;
+
 private:
     const double ratio;
     const double damping;
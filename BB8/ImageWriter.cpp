@@ -0,0 +1,186 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+namespace {
+
+void append_big_endian(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(uint8_t(value >> 24));
+    out.push_back(uint8_t(value >> 16));
+    out.push_back(uint8_t(value >> 8));
+    out.push_back(uint8_t(value));
+}
+
+uint32_t crc32(const uint8_t* data, size_t size) {
+    static const auto table = []() {
+        std::array<uint32_t, 256> table;
+
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+
+        return table;
+    }();
+
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    }
+
+    return c ^ 0xFFFFFFFFu;
+}
+
+// Reserves a PNG chunk's length and writes its type, returning where it starts
+size_t begin_chunk(std::vector<uint8_t>& out, const char* type) {
+    size_t chunk_start = out.size();
+
+    out.resize(out.size() + 4);
+    out.insert(out.end(), type, type + 4);
+
+    return chunk_start;
+}
+
+// Fills in the length of a chunk from begin_chunk, once its data follows, and
+// appends its CRC
+void finish_chunk(std::vector<uint8_t>& out, size_t chunk_start) {
+    size_t data_start = chunk_start + 8;
+    uint32_t length = uint32_t(out.size() - data_start);
+
+    out[chunk_start + 0] = uint8_t(length >> 24);
+    out[chunk_start + 1] = uint8_t(length >> 16);
+    out[chunk_start + 2] = uint8_t(length >> 8);
+    out[chunk_start + 3] = uint8_t(length);
+
+    // CRC covers the type and the data
+    append_big_endian(out, crc32(out.data() + chunk_start + 4, length + 4));
+}
+
+}
+
+ImageWriter::ImageWriter(uint32_t width, uint32_t height, ImageFormat format)
+    : width(width), height(height), format(format) {}
+
+bool ImageWriter::Write(std::FILE* file, const std::vector<uint8_t>& bgra) {
+    switch (format) {
+    case ImageFormat::BGRA:
+        return std::fwrite(bgra.data(), 1, bgra.size(), file) == bgra.size();
+    case ImageFormat::PPM:
+        EncodePPM(bgra);
+        break;
+    case ImageFormat::PNG:
+        EncodePNG(bgra);
+        break;
+    }
+
+    return std::fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+}
+
+const char* ImageWriter::Extension(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::BGRA:
+        return ".bgra";
+    case ImageFormat::PPM:
+        return ".ppm";
+    case ImageFormat::PNG:
+        return ".png";
+    }
+
+    return "";
+}
+
+void ImageWriter::EncodePPM(const std::vector<uint8_t>& bgra) {
+    std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+
+    encoded.assign(header.begin(), header.end());
+    encoded.reserve(header.size() + 3 * size_t(width) * height);
+
+    for (size_t i = 0; i < bgra.size(); i += 4) {
+        encoded.push_back(bgra[i + 2]);
+        encoded.push_back(bgra[i + 1]);
+        encoded.push_back(bgra[i + 0]);
+    }
+}
+
+void ImageWriter::EncodePNG(const std::vector<uint8_t>& bgra) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    // each row is a filter type byte, 0 for none, then RGB
+    size_t row_size = 1 + 3 * size_t(width);
+    size_t raw_size = row_size * height;
+
+    // stored deflate blocks hold at most 65535 bytes, with 5 bytes of header each
+    constexpr size_t max_block = 65535;
+    size_t blocks = (raw_size + max_block - 1) / max_block;
+
+    encoded.clear();
+    encoded.reserve(64 + raw_size + 5 * blocks);
+    encoded.insert(encoded.end(), signature, signature + 8);
+
+    size_t chunk = begin_chunk(encoded, "IHDR");
+    append_big_endian(encoded, width);
+    append_big_endian(encoded, height);
+    encoded.push_back(8);    // bit depth
+    encoded.push_back(2);    // truecolor
+    encoded.push_back(0);    // deflate
+    encoded.push_back(0);    // adaptive filtering
+    encoded.push_back(0);    // no interlace
+    finish_chunk(encoded, chunk);
+
+    chunk = begin_chunk(encoded, "IDAT");
+
+    // zlib header, deflate with a 32K window and no preset dictionary
+    encoded.push_back(0x78);
+    encoded.push_back(0x01);
+
+    scanlines.resize(raw_size);
+
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* row = bgra.data() + 4 * size_t(width) * y;
+        uint8_t* out = scanlines.data() + row_size * y;
+
+        *out++ = 0;
+        for (uint32_t x = 0; x < width; x++) {
+            *out++ = row[4 * x + 2];
+            *out++ = row[4 * x + 1];
+            *out++ = row[4 * x + 0];
+        }
+    }
+
+    for (size_t offset = 0; offset < raw_size; offset += max_block) {
+        size_t length = std::min(max_block, raw_size - offset);
+        bool final_block = offset + length == raw_size;
+
+        encoded.push_back(final_block ? 1 : 0);
+        encoded.push_back(uint8_t(length));
+        encoded.push_back(uint8_t(length >> 8));
+        encoded.push_back(uint8_t(~length));
+        encoded.push_back(uint8_t(~length >> 8));
+        encoded.insert(encoded.end(), scanlines.begin() + offset, scanlines.begin() + offset + length);
+    }
+
+    // Adler-32, reducing only as often as the sums could overflow
+    uint32_t adler_a = 1, adler_b = 0;
+    for (size_t offset = 0; offset < raw_size; offset += 5552) {
+        size_t end = std::min(raw_size, offset + 5552);
+
+        for (size_t i = offset; i < end; i++) {
+            adler_a += scanlines[i];
+            adler_b += adler_a;
+        }
+
+        adler_a %= 65521;
+        adler_b %= 65521;
+    }
+
+    append_big_endian(encoded, (adler_b << 16) | adler_a);
+    finish_chunk(encoded, chunk);
+
+    chunk = begin_chunk(encoded, "IEND");
+    finish_chunk(encoded, chunk);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+enum class ImageFormat {
+    // raw 4 bytes per pixel, as RenderDevice stores them
+    BGRA,
+    // binary portable pixmap, 8 bit RGB
+    PPM,
+    // 8 bit RGB, stored uncompressed so encoding costs no more than a copy
+    PNG,
+};
+
+// Encodes BGRA frames from RenderDevice::ColorBuffer. Alpha is dropped by
+// the RGB formats. Frames written back to back to one stream, e.g. a pipe
+// into a video encoder, stay decodable for every format.
+class ImageWriter
+{
+public:
+    ImageWriter(uint32_t width, uint32_t height, ImageFormat format);
+
+    // false on a short write
+    bool Write(std::FILE* file, const std::vector<uint8_t>& bgra);
+
+    static const char* Extension(ImageFormat format);
+
+private:
+    const uint32_t width;
+    const uint32_t height;
+    const ImageFormat format;
+
+    // reused between frames
+    std::vector<uint8_t> encoded;
+    std::vector<uint8_t> scanlines;
+
+    void EncodePPM(const std::vector<uint8_t>& bgra);
+    void EncodePNG(const std::vector<uint8_t>& bgra);
+};
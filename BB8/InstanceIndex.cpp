@@ -0,0 +1,145 @@
+#include "InstanceIndex.h"
+
+#include <algorithm>
+#include <utility>
+
+void InstanceIndex::Build(const std::vector<Mesh::Sphere>& spheres) {
+    bounds = spheres;
+    nodes.clear();
+    order.resize(spheres.size());
+
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+
+    if (!order.empty()) {
+        nodes.reserve(2 * (order.size() / LEAF_SIZE + 1));
+        BuildNode(0, uint32_t(order.size()));
+    }
+}
+
+uint32_t InstanceIndex::BuildNode(uint32_t begin, uint32_t end) {
+    uint32_t index = uint32_t(nodes.size());
+    nodes.emplace_back();
+
+    Vector3 min = bounds[order[begin]].center, max = min;
+    Vector3 center_min = min, center_max = min;
+
+    for (uint32_t i = begin; i < end; i++) {
+        const auto& sphere = bounds[order[i]];
+        const Vector3& c = sphere.center;
+        double r = sphere.radius;
+
+        min = Vector3(std::min(min.X, c.X - r), std::min(min.Y, c.Y - r), std::min(min.Z, c.Z - r));
+        max = Vector3(std::max(max.X, c.X + r), std::max(max.Y, c.Y + r), std::max(max.Z, c.Z + r));
+        center_min = Vector3(std::min(center_min.X, c.X), std::min(center_min.Y, c.Y), std::min(center_min.Z, c.Z));
+        center_max = Vector3(std::max(center_max.X, c.X), std::max(center_max.Y, c.Y), std::max(center_max.Z, c.Z));
+    }
+
+    nodes[index].min = min;
+    nodes[index].max = max;
+
+    if (end - begin <= LEAF_SIZE) {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        return index;
+    }
+
+    // Split at the median along the axis the centers spread most
+    Vector3 spread = Vector3::Subtract(center_max, center_min);
+    int axis = spread.X >= spread.Y && spread.X >= spread.Z ? 0 : (spread.Y >= spread.Z ? 1 : 2);
+
+    auto coordinate = [axis](const Vector3& v) {
+        return axis == 0 ? v.X : (axis == 1 ? v.Y : v.Z);
+    };
+
+    uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](uint32_t a, uint32_t b) {
+        return coordinate(bounds[a].center) < coordinate(bounds[b].center);
+    });
+
+    uint32_t left = BuildNode(begin, middle);
+    uint32_t right = BuildNode(middle, end);
+
+    nodes[index].first = begin;
+    nodes[index].count = 0;
+    nodes[index].left = left;
+    nodes[index].right = right;
+
+    return index;
+}
+
+void InstanceIndex::Query(const std::vector<Vector4>& planes, std::vector<uint32_t>& inside) const {
+    inside.clear();
+
+    if (nodes.empty()) {
+        return;
+    }
+
+    // nodes still to visit, with a bit per plane their box may cross
+    uint32_t all_planes = (1u << planes.size()) - 1;
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, all_planes } };
+
+    while (!stack.empty()) {
+        auto [index, crossing] = stack.back();
+        stack.pop_back();
+
+        const Node& node = nodes[index];
+        bool outside = false;
+
+        for (size_t p = 0; p < planes.size() && !outside; p++) {
+            if ((crossing & (1u << p)) == 0) {
+                continue;
+            }
+
+            const Vector4& plane = planes[p];
+
+            // the box's corners farthest along and against the plane normal
+            double farthest = plane.W
+                + plane.X * (plane.X >= 0.0 ? node.max.X : node.min.X)
+                + plane.Y * (plane.Y >= 0.0 ? node.max.Y : node.min.Y)
+                + plane.Z * (plane.Z >= 0.0 ? node.max.Z : node.min.Z);
+            double nearest = plane.W
+                + plane.X * (plane.X >= 0.0 ? node.min.X : node.max.X)
+                + plane.Y * (plane.Y >= 0.0 ? node.min.Y : node.max.Y)
+                + plane.Z * (plane.Z >= 0.0 ? node.min.Z : node.max.Z);
+
+            if (farthest < 0.0) {
+                outside = true;
+            } else if (nearest >= 0.0) {
+                // wholly inside this plane, so descendants needn't test it
+                crossing &= ~(1u << p);
+            }
+        }
+
+        if (outside) {
+            continue;
+        }
+
+        if (node.count == 0) {
+            stack.push_back({ node.left, crossing });
+            stack.push_back({ node.right, crossing });
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            uint32_t sphere_index = order[i];
+            const auto& sphere = bounds[sphere_index];
+            bool visible = true;
+
+            for (size_t p = 0; p < planes.size() && visible; p++) {
+                if (crossing & (1u << p)) {
+                    const Vector4& plane = planes[p];
+                    double distance = plane.X * sphere.center.X + plane.Y * sphere.center.Y + plane.Z * sphere.center.Z + plane.W;
+                    double length = Vector3::Length(Vector3(plane.X, plane.Y, plane.Z));
+
+                    visible = distance >= -sphere.radius * length;
+                }
+            }
+
+            if (visible) {
+                inside.push_back(sphere_index);
+            }
+        }
+    }
+}
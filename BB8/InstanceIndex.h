@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+#include "Vector3.h"
+#include "Vector4.h"
+
+// Bounding volume hierarchy over spheres, e.g. the bounds of many posed
+// copies of one mesh, for finding those inside a convex region such as the
+// view without testing every one
+class InstanceIndex {
+public:
+    // Rebuilds the hierarchy; cheap enough to do each frame
+    void Build(const std::vector<Mesh::Sphere>& spheres);
+
+    // Indices of the spheres not entirely outside any of the planes, given
+    // as (x, y, z, w) coefficients that are nonnegative inside
+    void Query(const std::vector<Vector4>& planes, std::vector<uint32_t>& inside) const;
+
+private:
+    // spheres in a leaf
+    static constexpr uint32_t LEAF_SIZE = 4;
+
+    // Box around a node's spheres. Leaves hold count spheres from first in
+    // order; inner nodes have count 0, with children at left and right.
+    class Node {
+    public:
+        Vector3 min, max;
+        uint32_t first, count;
+        uint32_t left, right;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+    std::vector<Mesh::Sphere> bounds;
+
+    uint32_t BuildNode(uint32_t begin, uint32_t end);
+};
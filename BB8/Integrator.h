@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+enum class IntegrationMethod {
+    // the simulation's original sequential update
+    ForwardEuler,
+    // rates first, then coordinates from the updated rates
+    SemiImplicitEuler,
+    // classic fourth order Runge-Kutta
+    RK4,
+    // adaptive Dormand-Prince 5(4) with error control
+    DormandPrince,
+    // motor current integrated exactly inside a coarser mechanical step
+    MultiRate,
+};
+
+// Explicit one-step integrators over a fixed-size state vector.
+// derivative(state, rates) must fill rates with d(state)/dt.
+template <size_t N>
+class Integrator
+{
+public:
+    using State = std::array<double, N>;
+
+    template <typename Derivative>
+    static void ForwardEuler(State& y, double dt, Derivative&& derivative) {
+        State k;
+        derivative(y, k);
+
+        for (size_t i = 0; i < N; i++) {
+            y[i] += dt * k[i];
+        }
+    }
+
+    // Components flagged in is_rate are advanced first; the rest are then
+    // advanced using rates evaluated with the updated values.
+    // kinematics(state, rates) need only fill the components not in is_rate,
+    // so the full derivative is evaluated once per step.
+    template <typename Derivative, typename Kinematics>
+    static void SemiImplicitEuler(State& y, double dt, Derivative&& derivative, Kinematics&& kinematics,
+        const std::array<bool, N>& is_rate) {
+        State k;
+        derivative(y, k);
+
+        for (size_t i = 0; i < N; i++) {
+            if (is_rate[i]) {
+                y[i] += dt * k[i];
+            }
+        }
+
+        kinematics(y, k);
+
+        for (size_t i = 0; i < N; i++) {
+            if (!is_rate[i]) {
+                y[i] += dt * k[i];
+            }
+        }
+    }
+
+    template <typename Derivative>
+    static void RK4(State& y, double dt, Derivative&& derivative) {
+        State k1, k2, k3, k4, trial;
+
+        derivative(y, k1);
+        for (size_t i = 0; i < N; i++) trial[i] = y[i] + 0.5 * dt * k1[i];
+
+        derivative(trial, k2);
+        for (size_t i = 0; i < N; i++) trial[i] = y[i] + 0.5 * dt * k2[i];
+
+        derivative(trial, k3);
+        for (size_t i = 0; i < N; i++) trial[i] = y[i] + dt * k3[i];
+
+        derivative(trial, k4);
+        for (size_t i = 0; i < N; i++) {
+            y[i] += dt / 6.0 * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+        }
+    }
+
+    // One Dormand-Prince 5(4) trial step. k1 must hold derivative(y) on entry.
+    // Returns the scaled RMS error estimate; the step should be accepted when
+    // it is at most 1, in which case y and k1 (first same as last) are advanced.
+    template <typename Derivative>
+    static double DormandPrince(State& y, State& k1, double dt, Derivative&& derivative, double absolute_tolerance, double relative_tolerance) {
+        State k2, k3, k4, k5, k6, k7, trial, next;
+
+        for (size_t i = 0; i < N; i++) trial[i] = y[i] + dt * (1.0 / 5.0 * k1[i]);
+        derivative(trial, k2);
+
+        for (size_t i = 0; i < N; i++) trial[i] = y[i] + dt * (3.0 / 40.0 * k1[i] + 9.0 / 40.0 * k2[i]);
+        derivative(trial, k3);
+
+        for (size_t i = 0; i < N; i++) trial[i] = y[i] + dt * (44.0 / 45.0 * k1[i] - 56.0 / 15.0 * k2[i] + 32.0 / 9.0 * k3[i]);
+        derivative(trial, k4);
+
+        for (size_t i = 0; i < N; i++) {
+            trial[i] = y[i] + dt * (19372.0 / 6561.0 * k1[i] - 25360.0 / 2187.0 * k2[i] + 64448.0 / 6561.0 * k3[i] - 212.0 / 729.0 * k4[i]);
+        }
+        derivative(trial, k5);
+
+        for (size_t i = 0; i < N; i++) {
+            trial[i] = y[i] + dt * (9017.0 / 3168.0 * k1[i] - 355.0 / 33.0 * k2[i] + 46732.0 / 5247.0 * k3[i]
+                + 49.0 / 176.0 * k4[i] - 5103.0 / 18656.0 * k5[i]);
+        }
+        derivative(trial, k6);
+
+        for (size_t i = 0; i < N; i++) {
+            next[i] = y[i] + dt * (35.0 / 384.0 * k1[i] + 500.0 / 1113.0 * k3[i] + 125.0 / 192.0 * k4[i]
+                - 2187.0 / 6784.0 * k5[i] + 11.0 / 84.0 * k6[i]);
+        }
+        derivative(next, k7);
+
+        double sum = 0.0;
+        for (size_t i = 0; i < N; i++) {
+            double error = dt * (71.0 / 57600.0 * k1[i] - 71.0 / 16695.0 * k3[i] + 71.0 / 1920.0 * k4[i]
+                - 17253.0 / 339200.0 * k5[i] + 22.0 / 525.0 * k6[i] - 1.0 / 40.0 * k7[i]);
+            double scale = absolute_tolerance + relative_tolerance * std::max(std::fabs(y[i]), std::fabs(next[i]));
+            sum += (error / scale) * (error / scale);
+        }
+
+        double error = std::sqrt(sum / N);
+
+        if (error <= 1.0) {
+            y = next;
+            k1 = k7;
+        }
+
+        return std::isfinite(error) ? error : HUGE_VAL;
+    }
+
+    // Step size for the next attempt after a trial step with the given error
+    static double NextStepSize(double dt, double error) {
+        constexpr double safety = 0.9;
+
+        double factor = error > 0.0 ? safety * std::pow(error, -0.2) : 5.0;
+        return dt * std::min(5.0, std::max(0.2, factor));
+    }
+};
@@ -1,9 +1,56 @@
 #include "Lighting.h"
 
+#include <algorithm>
 #include <cmath>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHTING_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Normalize leaves vectors shorter than this alone
+constexpr float MIN_LENGTH_SQUARED = 1e-12f;
+
+}
+
+Lighting::Surfaces::Surfaces() {}
+
+Lighting::Surfaces::Surfaces(const Mesh& mesh) : count(mesh.Faces.size()) {
+    size_t padded = (count + 3) & ~size_t(3);
+
+    for (auto* component : { &normal_x, &normal_y, &normal_z, &position_x, &position_y, &position_z, &red, &green, &blue }) {
+        component->assign(padded, 0.0f);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const auto& face = mesh.Faces[i];
+        Vector3 normal = Vector3::Normalize(face.normal);
+
+        normal_x[i] = float(normal.X);
+        normal_y[i] = float(normal.Y);
+        normal_z[i] = float(normal.Z);
+        position_x[i] = float(face.position.X);
+        position_y[i] = float(face.position.Y);
+        position_z[i] = float(face.position.Z);
+        red[i] = float(face.color.Red);
+        green[i] = float(face.color.Green);
+        blue[i] = float(face.color.Blue);
+    }
+}
+
 void Lighting::AddLight(Light light) {
     lights.push_back(light);
+    version++;
+}
+
+uint64_t Lighting::Version() const {
+    return version;
+}
+
+const std::vector<Lighting::Light>& Lighting::Lights() const {
+    return lights;
 }
 
 Color Lighting::Model(Vector3 position, Vector3 normal, Color material) const {
@@ -25,3 +72,89 @@ Color Lighting::Model(Vector3 position, Vector3 normal, Color material) const {
 
     return result;
 }
+
+void Lighting::Model(const Surfaces& surfaces, const Quaternion& rotation, const Vector3& translation, std::vector<Color>& colors) const {
+    // Rotation keeps angles, so lighting a posed face is the same as lighting
+    // the unposed one by lights given the inverse pose
+    Quaternion inverse = rotation.Inverse();
+    std::vector<Light> local(lights);
+
+    for (auto& light : local) {
+        light.position = inverse.Rotate(Vector3::Subtract(light.position, translation));
+    }
+
+    colors.resize(surfaces.count);
+
+    for (size_t i = 0; i < surfaces.count; i += 4) {
+        float red[4], green[4], blue[4];
+
+#ifdef LIGHTING_SSE2
+        __m128 normal_x = _mm_loadu_ps(&surfaces.normal_x[i]);
+        __m128 normal_y = _mm_loadu_ps(&surfaces.normal_y[i]);
+        __m128 normal_z = _mm_loadu_ps(&surfaces.normal_z[i]);
+        __m128 position_x = _mm_loadu_ps(&surfaces.position_x[i]);
+        __m128 position_y = _mm_loadu_ps(&surfaces.position_y[i]);
+        __m128 position_z = _mm_loadu_ps(&surfaces.position_z[i]);
+
+        __m128 sum_red = _mm_setzero_ps();
+        __m128 sum_green = _mm_setzero_ps();
+        __m128 sum_blue = _mm_setzero_ps();
+
+        for (auto& light : local) {
+            __m128 direction_x = _mm_sub_ps(_mm_set1_ps(float(light.position.X)), position_x);
+            __m128 direction_y = _mm_sub_ps(_mm_set1_ps(float(light.position.Y)), position_y);
+            __m128 direction_z = _mm_sub_ps(_mm_set1_ps(float(light.position.Z)), position_z);
+
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x, direction_x), _mm_mul_ps(normal_y, direction_y)),
+                _mm_mul_ps(normal_z, direction_z));
+            __m128 length_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(direction_x, direction_x), _mm_mul_ps(direction_y, direction_y)),
+                _mm_mul_ps(direction_z, direction_z));
+
+            // divide only directions long enough to normalize
+            __m128 normalizable = _mm_cmpge_ps(length_squared, _mm_set1_ps(MIN_LENGTH_SQUARED));
+            __m128 length = _mm_or_ps(_mm_and_ps(normalizable, _mm_sqrt_ps(length_squared)), _mm_andnot_ps(normalizable, _mm_set1_ps(1.0f)));
+
+            __m128 diffuse = _mm_min_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_setzero_ps(), _mm_div_ps(dot, length)));
+
+            sum_red = _mm_add_ps(sum_red, _mm_add_ps(_mm_mul_ps(diffuse, _mm_set1_ps(float(light.diffuse.Red))), _mm_set1_ps(float(light.ambient.Red))));
+            sum_green = _mm_add_ps(sum_green, _mm_add_ps(_mm_mul_ps(diffuse, _mm_set1_ps(float(light.diffuse.Green))), _mm_set1_ps(float(light.ambient.Green))));
+            sum_blue = _mm_add_ps(sum_blue, _mm_add_ps(_mm_mul_ps(diffuse, _mm_set1_ps(float(light.diffuse.Blue))), _mm_set1_ps(float(light.ambient.Blue))));
+        }
+
+        __m128 one = _mm_set1_ps(1.0f);
+        _mm_storeu_ps(red, _mm_min_ps(one, _mm_mul_ps(_mm_loadu_ps(&surfaces.red[i]), sum_red)));
+        _mm_storeu_ps(green, _mm_min_ps(one, _mm_mul_ps(_mm_loadu_ps(&surfaces.green[i]), sum_green)));
+        _mm_storeu_ps(blue, _mm_min_ps(one, _mm_mul_ps(_mm_loadu_ps(&surfaces.blue[i]), sum_blue)));
+#else
+        for (int lane = 0; lane < 4; lane++) {
+            size_t face = i + lane;
+            float sum_red = 0.0f, sum_green = 0.0f, sum_blue = 0.0f;
+
+            for (auto& light : local) {
+                float direction_x = float(light.position.X) - surfaces.position_x[face];
+                float direction_y = float(light.position.Y) - surfaces.position_y[face];
+                float direction_z = float(light.position.Z) - surfaces.position_z[face];
+
+                float dot = surfaces.normal_x[face] * direction_x + surfaces.normal_y[face] * direction_y
+                    + surfaces.normal_z[face] * direction_z;
+                float length_squared = direction_x * direction_x + direction_y * direction_y + direction_z * direction_z;
+                float length = length_squared >= MIN_LENGTH_SQUARED ? std::sqrt(length_squared) : 1.0f;
+
+                float diffuse = std::min(1.0f, std::max(0.0f, dot / length));
+
+                sum_red += diffuse * float(light.diffuse.Red) + float(light.ambient.Red);
+                sum_green += diffuse * float(light.diffuse.Green) + float(light.ambient.Green);
+                sum_blue += diffuse * float(light.diffuse.Blue) + float(light.ambient.Blue);
+            }
+
+            red[lane] = std::min(1.0f, surfaces.red[face] * sum_red);
+            green[lane] = std::min(1.0f, surfaces.green[face] * sum_green);
+            blue[lane] = std::min(1.0f, surfaces.blue[face] * sum_blue);
+        }
+#endif
+
+        for (size_t lane = 0; lane < 4 && i + lane < surfaces.count; lane++) {
+            colors[i + lane] = Color(blue[lane], green[lane], red[lane], 1.0);
+        }
+    }
+}
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include "Camera.h"
 #include "Color.h"
+#include "Mesh.h"
+#include "Quaternion.h"
 #include "Vector3.h"
 
 class Lighting
@@ -16,11 +19,36 @@ public:
         Color ambient;
     };
 
+    // A mesh's faces laid out for lighting them all in one pass: unit
+    // normals, centers and material colors, one array per component, padded
+    // to a whole number of groups of four
+    class Surfaces {
+    public:
+        size_t count = 0;
+
+        std::vector<float> normal_x, normal_y, normal_z;
+        std::vector<float> position_x, position_y, position_z;
+        std::vector<float> red, green, blue;
+
+        Surfaces();
+        Surfaces(const Mesh& mesh);
+    };
+
     void AddLight(Light light);
 
     Color Model(Vector3 position, Vector3 normal, Color material) const;
 
+    // Colors of all the surfaces, posed by rotation then translation. Lights
+    // are moved into the surfaces' model space instead of the other way round.
+    void Model(const Surfaces& surfaces, const Quaternion& rotation, const Vector3& translation, std::vector<Color>& colors) const;
+
+    // Changes whenever the lights do, so results lit by them can be kept
+    uint64_t Version() const;
+
+    // in the order added
+    const std::vector<Light>& Lights() const;
+
 private:
     std::vector<Light> lights;
+    uint64_t version = 0;
 };
-
@@ -0,0 +1,43 @@
+#include "LodChain.h"
+
+#include <algorithm>
+
+LodChain::LodChain(double target_pixels) : target_pixels(target_pixels), current(0) {}
+
+void LodChain::AddLevel(const Mesh& mesh, double edge_length) {
+    levels.push_back({ RenderMesh(mesh), edge_length });
+}
+
+const RenderMesh& LodChain::Select(double pixels_per_unit) {
+    current = LevelFor(pixels_per_unit, current);
+
+    return levels[current].mesh;
+}
+
+size_t LodChain::LevelFor(double pixels_per_unit, size_t previous) const {
+    size_t level = std::min(previous, levels.size() - 1);
+
+    // A jump in distance can take either loop across several levels.
+    // Adjacent levels' ranges overlap, so only one of the two runs.
+    while (level + 1 < levels.size() && levels[level].edge_length * pixels_per_unit > target_pixels * HYSTERESIS) {
+        level++;
+    }
+
+    while (level > 0 && levels[level - 1].edge_length * pixels_per_unit < target_pixels / HYSTERESIS) {
+        level--;
+    }
+
+    return level;
+}
+
+const RenderMesh& LodChain::LevelMesh(size_t level) const {
+    return levels[level].mesh;
+}
+
+size_t LodChain::Level() const {
+    return current;
+}
+
+size_t LodChain::LevelCount() const {
+    return levels.size();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "RenderMesh.h"
+
+// Versions of one mesh at increasing density. Each frame the coarsest whose
+// triangles would still look small enough on screen is drawn, switching
+// only once a level is well past the target so views near a threshold don't
+// flicker between two.
+class LodChain {
+public:
+    // target_pixels is the on-screen size triangle edges are kept to
+    LodChain(double target_pixels = 64.0);
+
+    // Levels go from coarsest to finest; edge_length is the size of a
+    // level's triangles in model space
+    void AddLevel(const Mesh& mesh, double edge_length);
+
+    // The level for a view where a unit length spans pixels_per_unit
+    const RenderMesh& Select(double pixels_per_unit);
+
+    // The level Select would switch to from previous, for tracking many
+    // copies of the mesh at their own levels
+    size_t LevelFor(double pixels_per_unit, size_t previous) const;
+    const RenderMesh& LevelMesh(size_t level) const;
+
+    size_t Level() const;
+    size_t LevelCount() const;
+
+private:
+    // how far past the target a level's edges get before switching
+    static constexpr double HYSTERESIS = 1.25;
+
+    class Entry {
+    public:
+        RenderMesh mesh;
+        double edge_length;
+    };
+
+    double target_pixels;
+    std::vector<Entry> levels;
+    size_t current;
+};
@@ -32,6 +32,7 @@ MainWindow::MainWindow()
       factory(nullptr),
       render_target(nullptr),
       simulation(1.0, 9.0, 15.0, 0.7, 2e-4, Vector3(0.0, 0.0, 1.0)),
+      simulation_thread(simulation),
       imu(&simulation) {};
 
 MainWindow::~MainWindow() {
@@ -81,7 +82,7 @@ HRESULT MainWindow::CreateGraphicsResources() {
             D2D1::HwndRenderTargetProperties(hwnd, size),
             &render_target);
 
-        render_device = RenderDevice(size.width, size.height);
+        render_device = RenderDevice(size.width, size.height, &render_pool);
     }
 
     return hr;
@@ -108,7 +109,7 @@ void MainWindow::OnResize() {
     D2D1_SIZE_U size = D2D1::SizeU(rc.right, rc.bottom);
 
     render_target->Resize(size);
-    render_device = RenderDevice(size.width, size.height);
+    render_device = RenderDevice(size.width, size.height, &render_pool);
 }
 
 void MainWindow::OnKeyDown(UINT message, WPARAM wParam, LPARAM lParam) {
@@ -220,6 +221,9 @@ void MainWindow::Begin(int fps) {
     MSG msg;
     PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE);
 
+    // simulation runs in real time on its own thread from here on
+    simulation_thread.start();
+
     // Run the message loop.
     while (msg.message != WM_QUIT) {
         // Is there a message to process?
@@ -235,9 +239,11 @@ void MainWindow::Begin(int fps) {
 
             auto elapsed_time = std::chrono::duration<double>(current_time - last_render);
             double dt = elapsed_time.count();
+            const auto& state = simulation_thread.latest();
+            visualization.PollKeys();
             visualization.Update(
-                dt, simulation.get_position(), simulation.get_rotation(),
-                simulation.get_platform_rotation(), simulation.get_pendulum_rotation(), simulation.get_heading());
+                dt, state.position, state.rotation,
+                state.platform_rotation, state.pendulum_rotation, state.heading);
             visualization.Render(render_device);
             Display();
 
@@ -249,10 +255,10 @@ void MainWindow::Begin(int fps) {
             if (next_render < current_time) {
                 next_render = current_time + frame_duration;
             }
-
-            simulation.update(dt);
         }
     }
+
+    simulation_thread.stop();
 }
 
 void MainWindow::Display() {
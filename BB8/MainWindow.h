@@ -9,6 +9,8 @@
 #include "RenderDevice.h"
 #include "Visualization.h"
 #include "Simulation.h"
+#include "SimulationThread.h"
+#include "ThreadPool.h"
 
 class MainWindow {
 private:
@@ -25,9 +27,11 @@ private:
     ID2D1Factory* factory;
     ID2D1HwndRenderTarget* render_target;
 
+    ThreadPool render_pool;
     RenderDevice render_device;
 
     Simulation simulation;
+    SimulationThread simulation_thread;
     IMU imu;
     Visualization visualization;
 
@@ -86,6 +86,10 @@ Matrix Matrix::operator * (const Matrix& multiplier) const {
     return Matrix::Multiply(*this, multiplier);
 }
 
+Vector4 Matrix::Row(int index) const {
+    return Vector4(data[4 * index], data[4 * index + 1], data[4 * index + 2], data[4 * index + 3]);
+}
+
 Vector4 Matrix::operator* (const Vector4& vector) const {
     return Vector4(
         (vector.X * data[0]) + (vector.Y * data[1]) + (vector.Z * data[2]) + (vector.W * data[3]),
@@ -45,6 +45,9 @@ public:
 
     static Matrix Transformation(Quaternion rotation, Vector3 translation);
 
+    // Zero-based row, as the coefficients of one output component
+    Vector4 Row(int index) const;
+
     Matrix operator * (const Matrix& multiplier) const;
     Vector4 operator * (const Vector4& vector) const;
     Vector3 operator * (const Vector3& vector) const;
@@ -1,5 +1,6 @@
 #include "Mesh.h"
 
+#include <algorithm>
 #include <stack>
 
 Mesh::Face::Face() : A(0), B(0), C(0), color(0.0, 0.0, 0.0, 1.0) { }
@@ -9,7 +10,8 @@ Mesh::Face::Face(size_t a, size_t b, size_t c) : A(a), B(b), C(c), color(0.0, 0.
 Mesh::Mesh()
     : Vertices(std::vector<Vector3>()),
     Faces(std::vector<Mesh::Face>()),
-    Edges(std::vector<std::pair<size_t, size_t>>()) {}
+    Edges(std::vector<std::pair<size_t, size_t>>()),
+    Closed(false) {}
 
 void Mesh::addFace(size_t a, size_t b, size_t c, Color color) {
     Vector3 ab = Vector3::Subtract(Vertices[b], Vertices[a]);
@@ -29,3 +31,35 @@ void Mesh::addFace(size_t a, size_t b, size_t c, Color color, Vector3 normal) {
 
     Faces.push_back(face);
 }
+
+Mesh::Bounds Mesh::computeBounds() const {
+    Bounds bounds;
+
+    if (Vertices.empty()) {
+        return bounds;
+    }
+
+    bounds.min = Vertices[0];
+    bounds.max = Vertices[0];
+
+    for (const auto& vertex : Vertices) {
+        bounds.min = Vector3(std::min(bounds.min.X, vertex.X), std::min(bounds.min.Y, vertex.Y), std::min(bounds.min.Z, vertex.Z));
+        bounds.max = Vector3(std::max(bounds.max.X, vertex.X), std::max(bounds.max.Y, vertex.Y), std::max(bounds.max.Z, vertex.Z));
+    }
+
+    return bounds;
+}
+
+Mesh::Sphere Mesh::computeBoundingSphere() const {
+    Bounds bounds = computeBounds();
+
+    Sphere sphere;
+    sphere.center = Vector3::Divide(Vector3::Add(bounds.min, bounds.max), 2.0);
+    sphere.radius = 0.0;
+
+    for (const auto& vertex : Vertices) {
+        sphere.radius = std::max(sphere.radius, Vector3::Length(Vector3::Subtract(vertex, sphere.center)));
+    }
+
+    return sphere;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <utility>
 #include <vector>
 
 #include "Color.h"
@@ -19,12 +21,32 @@ public:
         Face(size_t a, size_t b, size_t c);
     };
 
+    // Axis-aligned box around the vertices, in model space
+    class Bounds {
+    public:
+        Vector3 min;
+        Vector3 max;
+    };
+
+    class Sphere {
+    public:
+        Vector3 center;
+        double radius;
+    };
+
     std::vector<Vector3> Vertices;
     std::vector<Mesh::Face> Faces;
     std::vector<std::pair<size_t, size_t>> Edges;
 
+    // Faces enclose a volume and are wound counterclockwise seen from
+    // outside, so any facing away from the camera can be skipped
+    bool Closed;
+
     Mesh();
 
     void addFace(size_t a, size_t b, size_t c, Color color);
     void addFace(size_t a, size_t b, size_t c, Color color, Vector3 normal);
+
+    Bounds computeBounds() const;
+    Sphere computeBoundingSphere() const;
 };
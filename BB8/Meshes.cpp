@@ -30,11 +30,55 @@ Mesh Robot(double radius, int density) {
         }
     }
 
+    sphere.Closed = true;
+
     auto primary_color = Color(0.3, 0.3, 0.3, 1.0);
     auto polar_color = Color(1.0, 0.7, 0.3, 1.0);
     auto stripe_color = Color(0.3, 0.8, 1.0, 1.0);
 
+    // Caps beyond this latitude are polar colored
+    constexpr double polar_latitude = PI / 3.0;
+
+    // The stripe is the zigzag of triangles along the equator of a sphere of
+    // this density. Denser spheres color the faces whose centers fall in it,
+    // which for multiples of it are exactly the faces tiling the zigzag.
+    constexpr int stripe_density = 12;
+
+    auto in_stripe = [](const Vector3& center) {
+        double latitude = std::atan2(center.Z, std::hypot(center.X, center.Y));
+        double longitude = std::atan2(center.Y, center.X);
+
+        if (longitude < 0.0) {
+            longitude += 2 * PI;
+        }
+
+        // position within one of the zigzag's cells, each a ring high
+        double cell_width = 2 * PI / stripe_density;
+        double ring_height = 0.5 * PI / stripe_density;
+        double u = std::fmod(longitude, cell_width) / cell_width;
+        double v = latitude / ring_height;
+
+        // above the equator it's the triangle with an edge along the
+        // equator, below it the one with an edge along the ring above
+        if (v >= 0.0 && v <= 1.0) {
+            return v <= u;
+        }
+
+        if (v < 0.0 && v >= -1.0) {
+            return v + 1.0 >= u;
+        }
+
+        return false;
+    };
+
+    auto center = [&sphere](size_t a, size_t b, size_t c) {
+        return Vector3::Divide(Vector3::Add(sphere.Vertices[a], Vector3::Add(sphere.Vertices[b], sphere.Vertices[c])), 3.0);
+    };
+
     for (size_t i = 0; i < 2 * density; i++) {
+        double middle = 0.5 * PI * (double(i) + 0.5 - density) / density;
+        bool polar = std::abs(middle) > polar_latitude;
+
         for (size_t j = 0; j < density; j++) {
             size_t a = i * density + j;
             size_t b = i * density + ((j + 1) % density);
@@ -45,13 +89,18 @@ Mesh Robot(double radius, int density) {
             sphere.Edges.push_back(std::pair<size_t, size_t>(a, c));
             sphere.Edges.push_back(std::pair<size_t, size_t>(a, d));
 
-            auto color = (i <= 3 || i >= 2 * density - 4) ? polar_color : primary_color;
-            
-            sphere.addFace(a, b, d, (i == density) ? stripe_color : color);
+            auto color = polar ? polar_color : primary_color;
+
+            // coarser spheres' rings are wider than the stripe, so they take
+            // the triangles along the equator the zigzag would
+            bool stripe_upper = density < stripe_density ? i == density : in_stripe(center(a, b, d));
+            bool stripe_lower = density < stripe_density ? i + 1 == density : in_stripe(center(a, d, c));
+
+            sphere.addFace(a, b, d, stripe_upper ? stripe_color : color);
             Vector3 normal = sphere.Faces[sphere.Faces.size() - 1].position;
             sphere.Faces[sphere.Faces.size() - 1].normal = normal;
 
-            sphere.addFace(a, d, c, (i == density - 1) ? stripe_color : color);
+            sphere.addFace(a, d, c, stripe_lower ? stripe_color : color);
             normal = sphere.Faces[sphere.Faces.size() - 1].position;
             sphere.Faces[sphere.Faces.size() - 1].normal = normal;
         }
@@ -76,23 +125,26 @@ Mesh Platform(double width, double thickness) {
     platform.Vertices.push_back(Vector3(0.5 * width, 0.5 * thickness, -0.5 * width));
     platform.Vertices.push_back(Vector3(0.5 * width, -0.5 * thickness, -0.5 * width));
 
+    // wound counterclockwise seen from outside, so normals point out
+    platform.Closed = true;
+
     platform.addFace(0, 2, 4, color);
     platform.addFace(4, 6, 0, color);
 
-    platform.addFace(1, 3, 5, color);
-    platform.addFace(5, 7, 1, color);
+    platform.addFace(1, 5, 3, color);
+    platform.addFace(5, 1, 7, color);
 
-    platform.addFace(0, 2, 3, color);
-    platform.addFace(3, 1, 0, color);
+    platform.addFace(0, 3, 2, color);
+    platform.addFace(3, 0, 1, color);
 
-    platform.addFace(2, 4, 5, color);
-    platform.addFace(5, 3, 2, color);
+    platform.addFace(2, 5, 4, color);
+    platform.addFace(5, 2, 3, color);
 
-    platform.addFace(4, 6, 7, color);
-    platform.addFace(7, 5, 4, color);
+    platform.addFace(4, 7, 6, color);
+    platform.addFace(7, 4, 5, color);
 
-    platform.addFace(6, 0, 1, color);
-    platform.addFace(1, 7, 6, color);
+    platform.addFace(6, 1, 0, color);
+    platform.addFace(1, 6, 7, color);
 
     return platform;
 }
@@ -113,47 +165,53 @@ Mesh Pendulum(double thickness, double length) {
     pendulum.Vertices.push_back(Vector3(0.5 * thickness, 0.0 * length, -0.5 * thickness));
     pendulum.Vertices.push_back(Vector3(0.5 * thickness, -1.0 * length, -0.5 * thickness));
 
+    // wound counterclockwise seen from outside, so normals point out
+    pendulum.Closed = true;
+
     pendulum.addFace(0, 2, 4, color);
     pendulum.addFace(4, 6, 0, color);
 
-    pendulum.addFace(1, 3, 5, color);
-    pendulum.addFace(5, 7, 1, color);
+    pendulum.addFace(1, 5, 3, color);
+    pendulum.addFace(5, 1, 7, color);
 
-    pendulum.addFace(0, 2, 3, color);
-    pendulum.addFace(3, 1, 0, color);
+    pendulum.addFace(0, 3, 2, color);
+    pendulum.addFace(3, 0, 1, color);
 
-    pendulum.addFace(2, 4, 5, color);
-    pendulum.addFace(5, 3, 2, color);
+    pendulum.addFace(2, 5, 4, color);
+    pendulum.addFace(5, 2, 3, color);
 
-    pendulum.addFace(4, 6, 7, color);
-    pendulum.addFace(7, 5, 4, color);
+    pendulum.addFace(4, 7, 6, color);
+    pendulum.addFace(7, 4, 5, color);
 
-    pendulum.addFace(6, 0, 1, color);
-    pendulum.addFace(1, 7, 6, color);
+    pendulum.addFace(6, 1, 0, color);
+    pendulum.addFace(1, 6, 7, color);
 
     return pendulum;
 }
 
-Mesh Plane(double square_size, int extent) {
+Mesh Plane(double square_size, int extent, int subdivision) {
     Mesh plane;
 
-    for (int x = -extent; x <= extent; x++) {
-        for (int y = -extent; y <= extent; y++) {
-            plane.Vertices.push_back(Vector3(x * square_size, y * square_size, 0.0));
+    int cells = 2 * extent * subdivision;
+    double step = square_size / subdivision;
+
+    for (int x = 0; x <= cells; x++) {
+        for (int y = 0; y <= cells; y++) {
+            plane.Vertices.push_back(Vector3((x - extent * subdivision) * step, (y - extent * subdivision) * step, 0.0));
         }
     }
 
     Color gray(0.6, 0.6, 0.6, 1.0);
     Color red(0.0, 0.0, 1.0, 1.0);
 
-    for (int i = 0; i < 2 * extent; i++) {
-        for (int j = 0; j < 2*extent; j++) {
-            size_t a = i * (2 * extent + 1) + j;
-            size_t b = (i + 1) * (2 * extent + 1) + j;
-            size_t c = i * (2 * extent + 1) + (j + 1);
-            size_t d = (i + 1) * (2 * extent + 1) + (j + 1);
+    for (int i = 0; i < cells; i++) {
+        for (int j = 0; j < cells; j++) {
+            size_t a = i * (cells + 1) + j;
+            size_t b = (i + 1) * (cells + 1) + j;
+            size_t c = i * (cells + 1) + (j + 1);
+            size_t d = (i + 1) * (cells + 1) + (j + 1);
 
-            auto color = (i + j) % 2 == 0 ? gray : red;
+            auto color = (i / subdivision + j / subdivision) % 2 == 0 ? gray : red;
             plane.addFace(a, b, c, color);
             plane.addFace(c, b, d, color);
         }
@@ -2,9 +2,13 @@
 
 #include "Mesh.h"
 
+// density is the number of segments around the equator, with twice as many
+// rings from pole to pole; markings keep their place at any density
 Mesh Robot(double radius, int density);
 
 Mesh Platform(double width, double thickness);
 Mesh Pendulum(double thickness, double length);
 
-Mesh Plane(double square_size, int extent);
+// Checkerboard of squares reaching extent squares out from the origin, each
+// split into subdivision by subdivision pairs of triangles
+Mesh Plane(double square_size, int extent, int subdivision = 1);
@@ -1,5 +1,7 @@
 #include "Motor.h"
 
+#include <cmath>
+
 Motor::Motor(double Kt, double Kv,
     double damping, double inertia,
     double resistance, double inductance)
@@ -8,11 +10,37 @@ Motor::Motor(double Kt, double Kv,
     angular_velocity(0.0), current(0.0) {}
 
 void Motor::update(double voltage, double torque, double dt) {
+    State rates = derivative(voltage, torque);
+
+    angular_velocity += rates.angular_velocity * dt;
+    current += rates.current * dt;
+}
+
+void Motor::update_current(double voltage, double dt) {
+    double steady_current = (voltage - Kv * angular_velocity) / resistance;
+    double decay = std::exp(-resistance / inductance * dt);
+
+    current = steady_current + (current - steady_current) * decay;
+}
+
+void Motor::update_velocity(double torque, double dt) {
+    angular_velocity += couplingAcceleration(torque) * dt;
+}
+
+Motor::State Motor::state() const {
+    return { angular_velocity, current };
+}
+
+void Motor::set_state(State state) {
+    angular_velocity = state.angular_velocity;
+    current = state.current;
+}
+
+Motor::State Motor::derivative(double voltage, double torque) const {
     double dw = couplingAcceleration(torque);
     double dI = (voltage - Kv*angular_velocity - resistance * current) / inductance;
 
-    angular_velocity += dw * dt;
-    current += dI * dt;
+    return { dw, dI };
 }
 
 double Motor::couplingAcceleration(double torque) const {
@@ -3,18 +3,38 @@
 class Motor
 {
 public:
+    class State {
+    public:
+        double angular_velocity;
+        double current;
+    };
+
     Motor(double Kt, double Kv,
         double damping, double inertia,
         double resistance, double inductance);
 
     void update(double voltage, double torque, double dt);
 
+    // Multi-rate halves of update. Current is integrated exactly over dt with
+    // speed held, which is stable for any dt; speed then follows the torque.
+    void update_current(double voltage, double dt);
+    void update_velocity(double torque, double dt);
+
+    State state() const;
+    void set_state(State state);
+
+    // time derivative of state, given applied voltage and load torque
+    State derivative(double voltage, double torque) const;
+
     // coupling behavior
     double couplingAcceleration(double torque) const;
     double couplingInertia(double torque) const;
 
     double velocity() const;
 
+    friend class MotorAssembly;
+    friend class SimulationBatch;
+
 private:
     const double Kt;
     const double Kv;
@@ -10,6 +10,30 @@ void MotorAssembly::update(double voltage, double output_torque, double dt) {
     gearbox.update(motor.velocity());
 }
 
+void MotorAssembly::update_current(double voltage, double dt) {
+    motor.update_current(voltage, dt);
+}
+
+void MotorAssembly::update_velocity(double output_torque, double dt) {
+    double motor_torque = gearbox.inputTorque(output_torque);
+
+    motor.update_velocity(motor_torque, dt);
+    gearbox.update(motor.velocity());
+}
+
+MotorAssembly::State MotorAssembly::state() const {
+    return { motor.state(), gearbox.velocity };
+}
+
+void MotorAssembly::set_state(State state) {
+    motor.set_state(state.motor);
+    gearbox.update(state.gearbox_velocity);
+}
+
+Motor::State MotorAssembly::derivative(double voltage, double output_torque) const {
+    return motor.derivative(voltage, gearbox.inputTorque(output_torque));
+}
+
 double MotorAssembly::velocity() const {
     return gearbox.outputSpeed(motor.velocity());
 }
@@ -29,3 +53,12 @@ double MotorAssembly::inertia(double output_torque) const {
 
     return output_inertia;
 }
+
+bool MotorAssembly::affine() const {
+    return true;
+}
+
+std::array<double, 8> MotorAssembly::parameters() const {
+    return { motor.Kt, motor.Kv, motor.damping, motor.inertia, motor.resistance, motor.inductance,
+        gearbox.ratio, gearbox.damping };
+}
@@ -1,19 +1,44 @@
 #pragma once
 
+#include <array>
+
 #include "Gearbox.h"
 #include "Motor.h"
 
 class MotorAssembly
 {
 public:
+    class State {
+    public:
+        Motor::State motor;
+        double gearbox_velocity;
+    };
+
     MotorAssembly(Motor motor, Gearbox gearbox);
 
     void update(double voltage, double output_torque, double dt);
 
+    // see Motor::update_current and Motor::update_velocity
+    void update_current(double voltage, double dt);
+    void update_velocity(double output_torque, double dt);
+
+    State state() const;
+    void set_state(State state);
+
+    // time derivative of motor state, given applied voltage and output torque
+    Motor::State derivative(double voltage, double output_torque) const;
+
     double velocity() const;
     double acceleration(double output_torque) const;
     double inertia(double output_torque) const;
 
+    // motor and gearbox are both linear in torque
+    bool affine() const;
+
+    // The motor's constants, then the gearbox's ratio and damping, for
+    // telling whether two assemblies behave alike
+    std::array<double, 8> parameters() const;
+
 private:
     Motor motor;
     Gearbox gearbox;
@@ -0,0 +1,178 @@
+#include "OfflineRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+OfflineRenderer::OfflineRenderer(uint32_t width, uint32_t height, ImageFormat format, std::string output_prefix,
+    size_t thread_count, uint32_t shadow_map_size)
+    : pool(thread_count),
+      render_device(width, height, &pool),
+      visualization(shadow_map_size),
+      writer(width, height, format),
+      format(format),
+      output_prefix(std::move(output_prefix)),
+      frames(0),
+      failed(false)
+{
+#ifdef _WIN32
+    if (this->output_prefix == "-") {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+}
+
+OfflineRenderer::~OfflineRenderer() {
+    if (output_prefix == "-") {
+        std::fflush(stdout);
+    }
+}
+
+bool OfflineRenderer::Ok() const {
+    return !failed;
+}
+
+size_t OfflineRenderer::Frames() const {
+    return frames;
+}
+
+void OfflineRenderer::SetSwarm(const std::vector<RenderDevice::Instance>& robots) {
+    visualization.UpdateSwarm(robots);
+}
+
+bool OfflineRenderer::RenderFrame(double elapsed_time, Vector3 sphere_location, Quaternion sphere_rotation,
+    Quaternion platform_rotation, Quaternion pendulum_rotation, double heading) {
+    visualization.Update(elapsed_time, sphere_location, sphere_rotation, platform_rotation, pendulum_rotation, heading);
+    visualization.Render(render_device);
+
+    std::FILE* file = OpenFrame();
+    if (!file) {
+        failed = true;
+        return false;
+    }
+
+    bool written = writer.Write(file, render_device.ColorBuffer());
+    written = CloseFrame(file) && written;
+
+    if (!written) {
+        failed = true;
+        return false;
+    }
+
+    frames++;
+    return true;
+}
+
+size_t OfflineRenderer::RenderSimulation(Simulation& simulation, double duration, double frame_rate) {
+    double frame_period = 1.0 / frame_rate;
+    size_t frame_count = size_t(std::floor(duration * frame_rate)) + 1;
+    size_t start = frames;
+
+    // Fixed step methods advance in whole steps only, showing the step
+    // nearest each frame's time, as a recording of the run played back does.
+    // Adaptive steps have no grid, so those frames fall on the frame times.
+    IntegrationMethod integration = simulation.get_integration();
+    double step = integration == IntegrationMethod::MultiRate ? simulation.get_mechanical_step() : simulation.get_time_step();
+    size_t steps = 0;
+    double time = 0.0;
+
+    for (size_t i = 0; i < frame_count; i++) {
+        double frame_time = i * frame_period;
+        double last_time = time;
+
+        if (integration == IntegrationMethod::DormandPrince) {
+            if (i > 0) {
+                simulation.update(frame_period);
+            }
+
+            time = frame_time;
+        } else {
+            for (size_t target = size_t(std::llround(frame_time / step)); steps < target; steps++) {
+                simulation.update(step);
+            }
+
+            time = steps * step;
+        }
+
+        bool written = RenderFrame(time - last_time, simulation.get_position(), simulation.get_rotation(),
+            simulation.get_platform_rotation(), simulation.get_pendulum_rotation(), simulation.get_heading());
+
+        if (!written) {
+            break;
+        }
+    }
+
+    return frames - start;
+}
+
+size_t OfflineRenderer::RenderTrajectory(const TrajectoryReader& trajectory, double frame_rate) {
+    size_t start = frames;
+
+    if (trajectory.rows() == 0) {
+        return 0;
+    }
+
+    double frame_period = 1.0 / frame_rate;
+    double start_time = std::max(0.0, trajectory.time(0));
+    double end_time = trajectory.time(trajectory.rows() - 1);
+
+    // frames fall on whole multiples of the frame period, as when rendering
+    // live, allowing for rounding accumulated in the recorded times
+    size_t first_frame = size_t(std::ceil(start_time * frame_rate - 1e-6));
+    size_t last_frame = size_t(std::floor(end_time * frame_rate + 1e-6));
+
+    // rows are in time order, so one forward scan finds every frame's row
+    size_t row = 0;
+
+    for (size_t i = first_frame; i <= last_frame; i++) {
+        double frame_time = i * frame_period;
+
+        // nearest row, so a frame matches the step it was recorded at
+        while (row + 1 < trajectory.rows()
+            && std::fabs(trajectory.time(row + 1) - frame_time) <= std::fabs(trajectory.time(row) - frame_time)) {
+            row++;
+        }
+
+        Quaternion pendulum_rotation = trajectory.pendulum_rotation(row);
+
+        bool written = RenderFrame(i > first_frame ? frame_period : 0.0, trajectory.position(row), trajectory.rotation(row),
+            trajectory.platform_rotation(row), pendulum_rotation, Heading(pendulum_rotation));
+
+        if (!written) {
+            break;
+        }
+    }
+
+    return frames - start;
+}
+
+std::FILE* OfflineRenderer::OpenFrame() {
+    if (output_prefix == "-") {
+        return stdout;
+    }
+
+    char number[32];
+    std::snprintf(number, sizeof(number), "%06zu", frames);
+
+    std::string path = output_prefix + number + ImageWriter::Extension(format);
+    return std::fopen(path.c_str(), "wb");
+}
+
+bool OfflineRenderer::CloseFrame(std::FILE* file) {
+    if (file == stdout) {
+        return true;
+    }
+
+    return std::fclose(file) == 0;
+}
+
+double OfflineRenderer::Heading(const Quaternion& pendulum_rotation) {
+    // The pendulum's axis is tilted a quarter turn past the platform, so it
+    // lies along the heading for any swing short of horizontal
+    Vector3 axis = pendulum_rotation.Rotate(Vector3(0, 0, 1));
+    return std::atan2(axis.X, -axis.Y);
+}
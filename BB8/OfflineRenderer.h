@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "ImageWriter.h"
+#include "Quaternion.h"
+#include "RenderDevice.h"
+#include "Simulation.h"
+#include "ThreadPool.h"
+#include "TrajectoryReader.h"
+#include "Vector3.h"
+#include "Visualization.h"
+
+// Renders the visualization without a window, writing every frame as an
+// image. Frames are produced as fast as they can be drawn and encoded, one
+// per frame period of simulated time.
+class OfflineRenderer
+{
+public:
+    // Frames go to output_prefix followed by a six digit frame number and
+    // the format's extension, or back to back to stdout for a prefix of "-",
+    // e.g. to pipe raw BGRA into a video encoder. Frames are rasterized on
+    // thread_count threads, 0 for one per core, with the robot's shadow
+    // looked up in a map shadow_map_size texels square.
+    OfflineRenderer(uint32_t width, uint32_t height, ImageFormat format, std::string output_prefix,
+        size_t thread_count = 0, uint32_t shadow_map_size = 1024);
+    ~OfflineRenderer();
+
+    OfflineRenderer(const OfflineRenderer&) = delete;
+    OfflineRenderer& operator=(const OfflineRenderer&) = delete;
+
+    // false once any frame failed to write
+    bool Ok() const;
+    size_t Frames() const;
+
+    // Other robots' spheres, drawn in every following frame
+    void SetSwarm(const std::vector<RenderDevice::Instance>& robots);
+
+    bool RenderFrame(double elapsed_time, Vector3 sphere_location, Quaternion sphere_rotation,
+        Quaternion platform_rotation, Quaternion pendulum_rotation, double heading);
+
+    // Steps the simulation frame by frame, returning the frames written. A
+    // fixed step simulation shows the step nearest each frame's time, so
+    // frames match its recording played back at the same frame rate.
+    size_t RenderSimulation(Simulation& simulation, double duration, double frame_rate);
+
+    // Plays back a recording, showing the row nearest each frame's time
+    size_t RenderTrajectory(const TrajectoryReader& trajectory, double frame_rate);
+
+private:
+    ThreadPool pool;
+    RenderDevice render_device;
+    Visualization visualization;
+    ImageWriter writer;
+
+    const ImageFormat format;
+    const std::string output_prefix;
+
+    size_t frames;
+    bool failed;
+
+    std::FILE* OpenFrame();
+    bool CloseFrame(std::FILE* file);
+
+    // Heading the pendulum hangs towards, since recordings don't store it
+    static double Heading(const Quaternion& pendulum_rotation);
+};
@@ -18,6 +18,26 @@ Quaternion Quaternion::Identity() {
     return Quaternion(1.0, 0.0, 0.0, 0.0);
 }
 
+Quaternion Quaternion::FromComponents(double r, double a, double b, double c) {
+    return Quaternion(r, a, b, c);
+}
+
+double Quaternion::R() const {
+    return r;
+}
+
+double Quaternion::A() const {
+    return a;
+}
+
+double Quaternion::B() const {
+    return b;
+}
+
+double Quaternion::C() const {
+    return c;
+}
+
 Quaternion Quaternion::Scale(double scale) const {
     return Quaternion(
         scale * r,
@@ -13,6 +13,13 @@ private:
 public:
     static Quaternion EulerAngle(double theta, Vector3 axis);
     static Quaternion Identity();
+    static Quaternion FromComponents(double r, double a, double b, double c);
+
+    // real part, then the i, j and k parts
+    double R() const;
+    double A() const;
+    double B() const;
+    double C() const;
 
     Quaternion Scale(double scale) const;
     double Dot(const Quaternion& q) const;
@@ -1,43 +1,347 @@
 #include "RenderDevice.h"
 
+#ifdef _WIN32
 #include "framework.h"
+#endif
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <limits>
 #include <sstream>
 
-constexpr double epsilon = 0.5;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RENDER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Vertices snap to 1/16 pixel, so coverage is decided exactly in integers
+constexpr int SUBPIXEL_BITS = 4;
+constexpr int64_t SUBPIXEL_ONE = int64_t(1) << SUBPIXEL_BITS;
+constexpr int64_t SUBPIXEL_HALF = SUBPIXEL_ONE / 2;
+
+// Triangles are walked in square blocks of pixels aligned to the screen, so
+// blocks an edge doesn't cross are accepted or rejected whole, and within
+// the rest edge values stay small enough for 32 bit lanes
+constexpr int BLOCK_SIZE = 8;
+
+// Depth stored for pixels nothing has been drawn to
+constexpr float FAR_DEPTH = std::numeric_limits<float>::max();
+
+// Whether anything with depth at least lower_bound would fail the depth test
+// everywhere the farthest stored depth is max_depth. Pixel depths are rounded
+// to float after stepping, so allow them to come out a little nearer.
+bool hidden(double lower_bound, float max_depth) {
+    return lower_bound > max_depth + 1e-6 * std::abs(max_depth);
+}
+
+// Projected x and y within this many times w land on screen
+constexpr double SCREEN_EXTENT = 0.5;
+
+// Triangles are clipped to a band this many times w around the screen. It
+// keeps snapped coordinates in range while rarely needing to clip at all.
+constexpr double GUARD_BAND = 2.0;
+
+constexpr int CLIP_PLANES = 5;
+
+// Vertex outcodes hold the planes at the screen's extent in the low bits, and
+// those of the guard band above them
+constexpr int SCREEN_OUTCODES = (1 << CLIP_PLANES) - 1;
+
+// Clip space plane as coefficients of (x, y, z, w), nonnegative inside: the
+// near plane, then left, right, bottom and top ones at the given extent
+Vector4 clip_plane(int plane, double extent) {
+    switch (plane) {
+    case 0:
+        return Vector4(0.0, 0.0, 1.0, 0.0);
+    case 1:
+        return Vector4(1.0, 0.0, 0.0, extent);
+    case 2:
+        return Vector4(-1.0, 0.0, 0.0, extent);
+    case 3:
+        return Vector4(0.0, 1.0, 0.0, extent);
+    default:
+        return Vector4(0.0, -1.0, 0.0, extent);
+    }
+}
+
+// The plane, given in the space transform maps to, in the space it maps from
+Vector4 untransformed_plane(const Matrix& transform, const Vector4& coefficients) {
+    return Vector4::Add(
+        Vector4::Add(Vector4::Multiply(transform.Row(0), coefficients.X), Vector4::Multiply(transform.Row(1), coefficients.Y)),
+        Vector4::Add(Vector4::Multiply(transform.Row(2), coefficients.Z), Vector4::Multiply(transform.Row(3), coefficients.W)));
+}
+
+// One bit for each plane the point is outside of
+int outcode(const Vector4& point, double extent) {
+    int code = 0;
+
+    for (int plane = 0; plane < CLIP_PLANES; plane++) {
+        if (Vector4::Dot(clip_plane(plane, extent), point) < 0.0) {
+            code |= 1 << plane;
+        }
+    }
+
+    return code;
+}
+
+// Whether a packed color covers what's beneath it, so needs no blending
+bool opaque(uint32_t color) {
+    return (color >> 24) == 0xFF;
+}
+
+// Premultiplied source over destination, with x/255 rounded as
+// (x + 128 + ((x + 128) >> 8)) >> 8 on two channels at once. Alpha keeps
+// the larger of the two.
+uint32_t blend(uint32_t source, uint32_t destination) {
+    uint32_t inverse = 255 - (source >> 24);
+
+    uint32_t blue_red = (destination & 0x00FF00FFu) * inverse + 0x00800080u;
+    uint32_t green_alpha = ((destination >> 8) & 0x00FF00FFu) * inverse + 0x00800080u;
+
+    blue_red = ((blue_red + ((blue_red >> 8) & 0x00FF00FFu)) >> 8) & 0x00FF00FFu;
+    green_alpha = ((green_alpha + ((green_alpha >> 8) & 0x00FF00FFu)) >> 8) & 0x00FF00FFu;
+
+    uint32_t color = (source + (blue_red | green_alpha << 8)) & 0x00FFFFFFu;
+    uint32_t alpha = std::max(source >> 24, destination >> 24);
+
+    return color | alpha << 24;
+}
+
+// Inverse of the 3x3 matrix in the rows' x, y and z, if it has one
+bool invert(const Vector4 (&rows)[3], double (&inverse)[3][3]) {
+    const Vector4 &a = rows[0], &b = rows[1], &c = rows[2];
+
+    double cofactors[3][3] = {
+        { b.Y * c.Z - b.Z * c.Y, a.Z * c.Y - a.Y * c.Z, a.Y * b.Z - a.Z * b.Y },
+        { b.Z * c.X - b.X * c.Z, a.X * c.Z - a.Z * c.X, a.Z * b.X - a.X * b.Z },
+        { b.X * c.Y - b.Y * c.X, a.Y * c.X - a.X * c.Y, a.X * b.Y - a.Y * b.X },
+    };
+
+    double determinant = a.X * cofactors[0][0] + a.Y * cofactors[1][0] + a.Z * cofactors[2][0];
+    if (determinant == 0.0) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            inverse[i][j] = cofactors[i][j] / determinant;
+        }
+    }
+
+    return true;
+}
+
+// Pixels farther than this from a shadow's receiver plane, as a fraction of
+// their distance from the camera, aren't on it
+constexpr double RECEIVER_TOLERANCE = 1e-3;
+
+// Side of the squares shadows are shaded in, each skipped if off the map
+constexpr int SHADOW_BLOCK_SIZE = 16;
+
+// Edge steps for ShadeQuad to treat all four pixels as covered
+constexpr int32_t FULL_COVERAGE[3] = { 0, 0, 0 };
+
+// Every channel, alpha too, scaled by amount / 256, for drawing a
+// premultiplied color over part of a pixel
+uint32_t fade(uint32_t color, uint32_t amount) {
+    uint32_t blue_red = ((color & 0x00FF00FFu) * amount >> 8) & 0x00FF00FFu;
+    uint32_t green_alpha = (((color >> 8) & 0x00FF00FFu) * amount >> 8) & 0x00FF00FFu;
+
+    return blue_red | green_alpha << 8;
+}
+
+#ifdef RENDER_SSE2
+// blend on four pixels
+__m128i blend(__m128i source, __m128i destination, uint32_t source_alpha) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i inverse = _mm_set1_epi16(int16_t(255 - source_alpha));
+    __m128i rounding = _mm_set1_epi16(128);
+
+    __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(destination, zero), inverse), rounding);
+    __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(destination, zero), inverse), rounding);
+
+    low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+    high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+
+    __m128i alpha_mask = _mm_set1_epi32(int32_t(0xFF000000u));
+    __m128i color = _mm_add_epi8(source, _mm_packus_epi16(low, high));
+    __m128i alpha = _mm_max_epu8(source, destination);
+
+    return _mm_or_si128(_mm_andnot_si128(alpha_mask, color), _mm_and_si128(alpha_mask, alpha));
+}
+#endif
+
+// w(x, y) = a*x + b*y + c at subpixel coordinates, positive inside and
+// biased so shared edges cover each pixel center exactly once
+struct Edge {
+    int64_t a, b, c;
+};
+
+Edge make_edge(int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+    Edge edge;
+    edge.a = y0 - y1;
+    edge.b = x1 - x0;
+    edge.c = -(edge.a * x0 + edge.b * y0);
+
+    // top-left rule: centers exactly on an edge belong to the triangle only
+    // if it is a top edge (horizontal, interior below) or a left edge
+    bool top = edge.a == 0 && edge.b > 0;
+    bool left = edge.a > 0;
+
+    if (!top && !left) {
+        edge.c -= 1;
+    }
+
+    return edge;
+}
+
+}
 
 RenderDevice::RenderDevice() : RenderDevice(0, 0) {}
 
-RenderDevice::RenderDevice(UINT32 width, UINT32 height)
-    : width(width), height(height) {
+RenderDevice::RenderDevice(uint32_t width, uint32_t height, ThreadPool* pool)
+    : width(width), height(height), pool(pool),
+      tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+      tiles_y((height + TILE_SIZE - 1) / TILE_SIZE),
+      blocks_x((width + BLOCK_SIZE - 1) / BLOCK_SIZE),
+      blocks_y((height + BLOCK_SIZE - 1) / BLOCK_SIZE) {
     color_buffer.resize(width * height * 4);
     depth_buffer.resize(width * height);
-    shadow_buffer.resize(width * height);
+
+    block_depth.resize(size_t(blocks_x) * blocks_y);
+    tile_depth.resize(size_t(tiles_x) * tiles_y);
+    tile_stale.resize(size_t(tiles_x) * tiles_y);
+    tile_generation.resize(size_t(tiles_x) * tiles_y);
+
+    if (pool) {
+        bins.resize(size_t(tiles_x) * tiles_y);
+    }
 }
 
 void RenderDevice::Clear(Color fillColor) {
-    // Buffer data is in 4 byte-per-pixel format, iterates from 0 to end of buffer
-    for (auto index = 0; index < color_buffer.size(); index += 4) {
-        // BGRA is the color system used by Windows.
-        color_buffer[index] = (char)(fillColor.Blue * 255);
-        color_buffer[index + 1] = (char)(fillColor.Green * 255);
-        color_buffer[index + 2] = (char)(fillColor.Red * 255);
-        color_buffer[index + 3] = (char)(fillColor.Alpha * 255);
+    // Anything still binned would have been drawn before the clear
+    triangles.clear();
+    for (auto& bin : bins) {
+        bin.clear();
+    }
+
+    // Depth is cleared a tile at a time, the first time each is drawn to
+    generation++;
+
+    uint32_t fill = fillColor.Packed();
+
+    if (pool) {
+        // Each band of tiles clears on its own thread
+        pool->parallel_for(tiles_y, [this, fill](size_t band) {
+            ClearRows(band * TILE_SIZE, std::min(size_t(height), (band + 1) * TILE_SIZE), fill);
+        });
+    } else {
+        ClearRows(0, height, fill);
+    }
+}
+
+void RenderDevice::ClearRows(size_t first_row, size_t end_row, uint32_t fill) {
+    uint8_t* pixels = color_buffer.data() + 4 * first_row * width;
+    size_t count = (end_row - first_row) * width;
+
+    // Gray clears, white and black among them, repeat a single byte
+    if ((fill & 0xFF) * 0x01010101u == fill) {
+        std::memset(pixels, int(fill & 0xFF), 4 * count);
+        return;
+    }
+
+    size_t i = 0;
+
+#ifdef RENDER_SSE2
+    __m128i fill4 = _mm_set1_epi32(int32_t(fill));
+
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + 4 * i), fill4);
+    }
+#endif
+
+    for (; i < count; i++) {
+        std::memcpy(pixels + 4 * i, &fill, 4);
+    }
+}
+
+void RenderDevice::SaveLayer(uint64_t key) {
+    Flush();
+
+    // Tiles not drawn to yet are kept clear
+    for (size_t tile = 0; tile < tile_generation.size(); tile++) {
+        TouchTile(tile);
+    }
+
+    layer.key = key;
+    layer.color_buffer = color_buffer;
+    layer.depth_buffer = depth_buffer;
+    layer.block_depth = block_depth;
+    layer.tile_depth = tile_depth;
+    layer.tile_stale = tile_stale;
+}
+
+bool RenderDevice::HasLayer(uint64_t key) const {
+    return key != 0 && layer.key == key;
+}
+
+void RenderDevice::RestoreLayer() {
+    triangles.clear();
+    for (auto& bin : bins) {
+        bin.clear();
+    }
+
+    // Every tile holds the layer's depth, so counts as drawn to this frame
+    generation++;
+    std::fill(tile_generation.begin(), tile_generation.end(), generation);
+
+    block_depth = layer.block_depth;
+    tile_depth = layer.tile_depth;
+    tile_stale = layer.tile_stale;
+
+    if (pool) {
+        pool->parallel_for(tiles_y, [this](size_t band) {
+            RestoreRows(band * TILE_SIZE, std::min(size_t(height), (band + 1) * TILE_SIZE));
+        });
+    } else {
+        RestoreRows(0, height);
     }
+}
+
+void RenderDevice::RestoreRows(size_t first_row, size_t end_row) {
+    size_t first = first_row * width, count = (end_row - first_row) * width;
+
+    std::memcpy(color_buffer.data() + 4 * first, layer.color_buffer.data() + 4 * first, 4 * count);
+    std::memcpy(depth_buffer.data() + first, layer.depth_buffer.data() + first, sizeof(float) * count);
+}
+
+void RenderDevice::TouchTile(size_t tile) {
+    if (tile_generation[tile] == generation) {
+        return;
+    }
+
+    Tile area = TileAt(tile);
 
-    // Clear the depth buffer
-    for (auto index = 0; index < depth_buffer.size(); index++) {
-        depth_buffer[index] = std::numeric_limits<double>::max();
+    for (int y = area.y0; y < area.y1; y++) {
+        float* row = depth_buffer.data() + size_t(y) * width;
+        std::fill(row + area.x0, row + area.x1, FAR_DEPTH);
     }
 
-    // Clear the shadow buffer
-    for (auto index = 0; index < shadow_buffer.size(); index++) {
-        shadow_buffer[index] = std::numeric_limits<double>::max();
+    int bx0 = area.x0 / BLOCK_SIZE, bx1 = (area.x1 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (int by = area.y0 / BLOCK_SIZE; by < (area.y1 + BLOCK_SIZE - 1) / BLOCK_SIZE; by++) {
+        float* row = block_depth.data() + size_t(by) * blocks_x;
+        std::fill(row + bx0, row + bx1, FAR_DEPTH);
     }
+
+    tile_depth[tile] = FAR_DEPTH;
+    tile_stale[tile] = 0;
+    tile_generation[tile] = generation;
 }
 
+#ifdef _WIN32
 HRESULT RenderDevice::PresentTo(ID2D1HwndRenderTarget* render_target) const {
     ID2D1Bitmap* bitmap;
 
@@ -69,259 +373,1085 @@ HRESULT RenderDevice::PresentTo(ID2D1HwndRenderTarget* render_target) const {
 
     return S_OK;
 }
+#endif
+
+uint32_t RenderDevice::Width() const {
+    return width;
+}
+
+uint32_t RenderDevice::Height() const {
+    return height;
+}
+
+const std::vector<uint8_t>& RenderDevice::ColorBuffer() const {
+    return color_buffer;
+}
 
-void RenderDevice::RenderSurface(const Camera& camera, const Lighting& lighting, const Mesh& mesh, const Quaternion& rotation, const Vector3& translation) {
+void RenderDevice::RenderSurface(const Camera& camera, const Lighting& lighting, const RenderMesh& mesh, const Quaternion& rotation, const Vector3& translation) {
     Matrix camera_transform = camera.ViewTransform(double(width)/height);
     Matrix model_transform = Matrix::Transformation(rotation, translation);
 
     Matrix transform = camera_transform * model_transform;
 
-    for (const auto& face : mesh.Faces) {
-        // Get each vertex for this face
-        const auto& vertex_a = mesh.Vertices[face.A];
-        const auto& vertex_b = mesh.Vertices[face.B];
-        const auto& vertex_c = mesh.Vertices[face.C];
+    // The depth pyramid must include everything drawn so far to cull against
+    Flush();
 
-        // Transform to get the pixel
-        auto [clip_a, pixel_a] = Project(vertex_a, transform);
-        auto [clip_b, pixel_b] = Project(vertex_b, transform);
-        auto [clip_c, pixel_c] = Project(vertex_c, transform);
+    if (OutsideView(mesh.BoundingSphere, transform)) {
+        return;
+    }
 
-        if (clip_a || clip_b || clip_c) {
-            continue;
-        }
+    DrawSurface(transform, camera.Position(), lighting, mesh, rotation, translation, true);
+}
+
+void RenderDevice::RenderInstances(const Camera& camera, const Lighting& lighting, const RenderMesh& mesh, const std::vector<Instance>& instances) {
+    Matrix camera_transform = camera.ViewTransform(double(width) / height);
+    Vector3 eye = camera.Position();
 
-        Vector3 normal = rotation.Rotate(face.normal);
-        Vector3 position = Vector3::Add(rotation.Rotate(face.position), translation);
+    Flush();
+
+    instance_bounds.resize(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        const Instance& instance = instances[i];
+
+        instance_bounds[i].center = Vector3::Add(instance.rotation.Rotate(mesh.BoundingSphere.center), instance.translation);
+        instance_bounds[i].radius = mesh.BoundingSphere.radius;
+    }
 
-        // Rasterize face as a triangles
-        auto color = lighting.Model(position, normal, face.color);
-        RasterizeTriangle(pixel_a, pixel_b, pixel_c, color);
+    // The view's planes in world space, to find instances within it
+    view_planes.clear();
+    for (int plane = 0; plane < CLIP_PLANES; plane++) {
+        view_planes.push_back(untransformed_plane(camera_transform, clip_plane(plane, SCREEN_EXTENT)));
+    }
+
+    instance_index.Build(instance_bounds);
+    instance_index.Query(view_planes, visible_instances);
+
+    // Nearest first, so the depth pyramid can skip more of those behind
+    std::sort(visible_instances.begin(), visible_instances.end(), [this, &eye](uint32_t a, uint32_t b) {
+        return Vector3::Length(Vector3::Subtract(instance_bounds[a].center, eye)) < Vector3::Length(Vector3::Subtract(instance_bounds[b].center, eye));
+    });
+
+    // Each is only tested against the depth pyramid as of the last flush;
+    // flushing between instances would cost more than it could cull
+    for (uint32_t i : visible_instances) {
+        const Instance& instance = instances[i];
+        Matrix transform = camera_transform * Matrix::Transformation(instance.rotation, instance.translation);
+
+        DrawSurface(transform, eye, lighting, mesh, instance.rotation, instance.translation, false);
     }
 }
 
-void RenderDevice::RenderWireframe(const Camera& camera, const Mesh& mesh, const Quaternion& rotation, const Vector3& translation, const Color& color, int thickness) {
+void RenderDevice::DrawSurface(const Matrix& transform, const Vector3& camera_position, const Lighting& lighting, const RenderMesh& mesh,
+    const Quaternion& rotation, const Vector3& translation, bool keep_lighting) {
+    if (Hidden(mesh.Bounds, transform)) {
+        return;
+    }
+
+    // Every face indexes into these, so shared vertices are transformed once
+    TransformVertices(mesh, transform);
+
+    const std::vector<uint32_t>* colors = &instance_colors;
+
+    if (keep_lighting) {
+        colors = &LightFaces(lighting, mesh, rotation, translation);
+    } else {
+        LightMesh(lighting, mesh, rotation, translation, instance_colors);
+    }
+
+    // Camera in model space, for finding faces turned away from it
+    Vector3 eye = rotation.Inverse().Rotate(Vector3::Subtract(camera_position, translation));
+
+    auto draw_faces = [&](const auto* indices) {
+        for (size_t i = 0; i < mesh.faceCount(); i++) {
+            size_t a = indices[3 * i], b = indices[3 * i + 1], c = indices[3 * i + 2];
+
+            // A closed mesh's back faces are covered by its front faces. Facing
+            // comes from the winding, as normals may be smoothed for lighting.
+            if (mesh.Closed) {
+                Vector3 vertex_a(mesh.X[a], mesh.Y[a], mesh.Z[a]);
+                Vector3 vertex_b(mesh.X[b], mesh.Y[b], mesh.Z[b]);
+                Vector3 vertex_c(mesh.X[c], mesh.Y[c], mesh.Z[c]);
+
+                Vector3 facing = Vector3::Cross(Vector3::Subtract(vertex_b, vertex_a), Vector3::Subtract(vertex_c, vertex_a));
+
+                if (Vector3::Dot(facing, Vector3::Subtract(vertex_a, eye)) >= 0.0) {
+                    continue;
+                }
+            }
+
+            int code_a = vertex_outcodes[a];
+            int code_b = vertex_outcodes[b];
+            int code_c = vertex_outcodes[c];
+
+            // Entirely beyond one edge of the screen
+            if (code_a & code_b & code_c & SCREEN_OUTCODES) {
+                continue;
+            }
+
+            uint32_t color = (*colors)[i];
+            int outside = (code_a | code_b | code_c) >> CLIP_PLANES;
+
+            if (outside == 0) {
+                SubmitTriangle(screen_vertices[a], screen_vertices[b], screen_vertices[c], color);
+            } else {
+                Vector4 clip[3] = { clip_vertices[a], clip_vertices[b], clip_vertices[c] };
+                ClipTriangle(clip, outside, color);
+            }
+        }
+    };
+
+    if (mesh.Triangles.Long.empty()) {
+        draw_faces(mesh.Triangles.Short.data());
+    } else {
+        draw_faces(mesh.Triangles.Long.data());
+    }
+}
+
+void RenderDevice::RenderWireframe(const Camera& camera, const RenderMesh& mesh, const Quaternion& rotation, const Vector3& translation, const Color& color, int thickness) {
+    // Lines are drawn directly, so surfaces submitted earlier go first
+    Flush();
+
     Matrix camera_transform = camera.ViewTransform(double(width) / height);
     Matrix model_transform = Matrix::Transformation(rotation, translation);
 
     Matrix transform = camera_transform * model_transform;
 
-    for (const auto& edge : mesh.Edges) {
-        const auto& vertex_a = mesh.Vertices[edge.first];
-        const auto& vertex_b = mesh.Vertices[edge.second];
+    TransformVertices(mesh, transform);
 
-        // Transform to get the pixel
-        auto [clip_a, pixel_a] = Project(vertex_a, transform);
-        auto [clip_b, pixel_b] = Project(vertex_b, transform);
+    uint32_t packed = color.Packed();
+    double half_width = 0.5 * thickness;
 
-        DrawLine(pixel_a, pixel_b, color, thickness);
-    }
-}
+    lines.clear();
+
+    auto add_edges = [&](const auto* indices) {
+        for (size_t i = 0; i < mesh.Lines.size(); i += 2) {
+            size_t a = indices[i], b = indices[i + 1];
 
-std::tuple<bool, Vector3> RenderDevice::Project(const Vector3& coord, const Matrix& transform) const {
-    Vector4 inclusion(coord.X, coord.Y, coord.Z, 1.0);
-    Vector4 product = transform * inclusion;
+            // Lines aren't clipped, so leave out any reaching past the guard band
+            if ((vertex_outcodes[a] | vertex_outcodes[b]) >> CLIP_PLANES) {
+                continue;
+            }
 
-    if (product.W < 0.0) {
-        return { true, Vector3() };
+            lines.push_back({ screen_vertices[a], screen_vertices[b] });
+        }
+    };
+
+    if (mesh.Lines.Long.empty()) {
+        add_edges(mesh.Lines.Short.data());
+    } else {
+        add_edges(mesh.Lines.Long.data());
+    }
+
+    if (!pool) {
+        for (const Line& line : lines) {
+            DrawLine(line.a, line.b, packed, half_width, Screen());
+        }
+        return;
     }
 
-    Vector3 camera_point = Vector3(product.X / product.W, product.Y / product.W, product.Z / product.W);
+    // Binned like triangles, by the box around each line and its width, and
+    // drawn a tile per task in the same order as serially
+    double reach = half_width + 1.0;
+
+    for (uint32_t i = 0; i < lines.size(); i++) {
+        const Line& line = lines[i];
+
+        double min_x = std::min(line.a.X, line.b.X) - reach, max_x = std::max(line.a.X, line.b.X) + reach;
+        double min_y = std::min(line.a.Y, line.b.Y) - reach, max_y = std::max(line.a.Y, line.b.Y) + reach;
+
+        if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height) {
+            continue;
+        }
+
+        int first_x = int(std::max(0.0, min_x)) / TILE_SIZE;
+        int last_x = int(std::min(width - 1.0, max_x)) / TILE_SIZE;
+        int first_y = int(std::max(0.0, min_y)) / TILE_SIZE;
+        int last_y = int(std::min(height - 1.0, max_y)) / TILE_SIZE;
 
-    if (camera_point.X < -2.0 || camera_point.X > 2.0 || camera_point.Y < -2.0 || camera_point.Y > 2.0) {
-        return { true, Vector3() };
+        for (int y = first_y; y <= last_y; y++) {
+            for (int x = first_x; x <= last_x; x++) {
+                bins[size_t(y) * tiles_x + x].push_back(i);
+            }
+        }
     }
 
-    // The transformed coordinates will be based on coordinate system
-    // starting on the center of the screen. But drawing on screen normally starts
-    // from top left. We then need to transform them again to have x:0, y:0 on top left.
-    // Includes Z pos for the Z-Buffer, un-transformed
-    double x = width * (camera_point.X + 0.5);
-    double y = height * (-camera_point.Y + 0.5);
-    Vector3 screen_point(x, y, camera_point.Z);
-    return { false, screen_point };
+    pool->parallel_for(bins.size(), [this, packed, half_width](size_t index) {
+        Tile tile = TileAt(index);
+
+        for (uint32_t line : bins[index]) {
+            DrawLine(lines[line].a, lines[line].b, packed, half_width, tile);
+        }
+    });
+
+    for (auto& bin : bins) {
+        bin.clear();
+    }
 }
 
-void RenderDevice::RasterizeTriangle(Vector3 p1, Vector3 p2, Vector3 p3, Color color) {
-    // Sort points
-    if (p1.Y > p2.Y) {
-        auto temp = p2;
-        p2 = p1;
-        p1 = temp;
+void RenderDevice::RenderShadow(const Camera& camera, const ShadowMap& shadow_map, const Vector4& receiver) {
+    // Shading goes by the depth of everything drawn
+    Flush();
+
+    if (!shadow_map.Ready()) {
+        return;
     }
-    if (p2.Y > p3.Y) {
-        auto temp = p2;
-        p2 = p3;
-        p3 = temp;
+
+    // The view's x, y and w rows take a world point to clip space, so their
+    // inverse takes a pixel's clip coordinates, from its position and depth,
+    // back to the world
+    Matrix camera_transform = camera.ViewTransform(double(width) / height);
+    Vector4 rows[3] = { camera_transform.Row(0), camera_transform.Row(1), camera_transform.Row(3) };
+
+    double inverse[3][3];
+    if (!invert(rows, inverse)) {
+        return;
     }
-    if (p1.Y > p2.Y) {
-        auto temp = p2;
-        p2 = p1;
-        p1 = temp;
+
+    Vector4 to_world[3];
+    for (int i = 0; i < 3; i++) {
+        double offset = inverse[i][0] * rows[0].W + inverse[i][1] * rows[1].W + inverse[i][2] * rows[2].W;
+        to_world[i] = Vector4(inverse[i][0], inverse[i][1], inverse[i][2], -offset);
     }
 
-    if (p3.Y - p1.Y < 1.0) {
+    // A function of world points as one of a pixel's clip x / w, y / w and
+    // w, see ShadeShadow
+    auto of_pixel = [&to_world](const Vector4& row) {
+        return Vector4(
+            row.X * to_world[0].X + row.Y * to_world[1].X + row.Z * to_world[2].X,
+            row.X * to_world[0].Y + row.Y * to_world[1].Y + row.Z * to_world[2].Y,
+            row.X * to_world[0].Z + row.Y * to_world[1].Z + row.Z * to_world[2].Z,
+            (row.X * to_world[0].W + row.Y * to_world[1].W) + (row.Z * to_world[2].W + row.W));
+    };
+
+    // with a unit normal, so distances from it are in world units
+    double normal_length = Vector3::Length(Vector3(receiver.X, receiver.Y, receiver.Z));
+    if (normal_length == 0.0) {
         return;
     }
 
-    if ((p2.Y - p1.Y < epsilon) && p1.X > p2.X) {
-        auto temp = p2;
-        p2 = p1;
-        p1 = temp;
-    }
+    Vector4 height_above = of_pixel(Vector4::Divide(receiver, normal_length));
+
+    const Matrix& light_transform = shadow_map.Transform();
+    Vector4 to_light[3] = { of_pixel(light_transform.Row(0)), of_pixel(light_transform.Row(1)), of_pixel(light_transform.Row(3)) };
+
+    // what's left of each channel in full shadow, out of 256
+    Color attenuation = shadow_map.Attenuation(Vector3(receiver.X, receiver.Y, receiver.Z));
+    uint32_t shaded[3] = {
+        uint32_t(std::lround(256.0 * attenuation.Blue)),
+        uint32_t(std::lround(256.0 * attenuation.Green)),
+        uint32_t(std::lround(256.0 * attenuation.Red)),
+    };
+
+    auto shade_tile = [&](size_t index) {
+        // a tile not drawn to since the clear holds only the background
+        if (tile_generation[index] != generation) {
+            return;
+        }
+
+        // in squares small enough to mostly pass or fail the test for being
+        // off the map as a whole
+        Tile tile = TileAt(index);
+
+        for (int y = tile.y0; y < tile.y1; y += SHADOW_BLOCK_SIZE) {
+            for (int x = tile.x0; x < tile.x1; x += SHADOW_BLOCK_SIZE) {
+                Tile block = { x, y, std::min(x + SHADOW_BLOCK_SIZE, tile.x1), std::min(y + SHADOW_BLOCK_SIZE, tile.y1) };
+                ShadeShadow(block, shadow_map, height_above, to_light, shaded);
+            }
+        }
+    };
 
-    // Calculate inverse slopes
-    double dP1P2, dP1P3;
-    bool horizontal = false;
+    size_t tile_count = size_t(tiles_x) * tiles_y;
 
-    if (p2.Y - p1.Y > epsilon) {
-        dP1P2 = (p2.X - p1.X) / (p2.Y - p1.Y);
+    if (pool) {
+        pool->parallel_for(tile_count, shade_tile);
     } else {
-        horizontal = true;
-        dP1P2 = 0;
+        for (size_t index = 0; index < tile_count; index++) {
+            shade_tile(index);
+        }
     }
+}
 
-    if (p3.Y - p1.Y > epsilon) {
-        dP1P3 = (p3.X - p1.X) / (p3.Y - p1.Y);
-    } else {
-        dP1P3 = 0;
+void RenderDevice::ShadeShadow(const Tile& area, const ShadowMap& shadow_map, const Vector4& height_above,
+    const Vector4 (&to_light)[3], const uint32_t (&shaded)[3]) {
+    // A function f of a pixel with clip coordinates x, y and w is
+    // (f.X * x / w + f.Y * y / w + f.Z) * w + f.W
+    double pixel_width = 1.0 / width, pixel_height = 1.0 / height;
+    auto clip_x = [pixel_width](int x) { return (x + 0.5) * pixel_width - 0.5; };
+    auto clip_y = [pixel_height](int y) { return 0.5 - (y + 0.5) * pixel_height; };
+
+    // Bounds on w from what's drawn in the area
+    float near_depth = FAR_DEPTH, far_depth = -FAR_DEPTH;
+
+    for (int y = area.y0; y < area.y1; y++) {
+        const float* row = depth_buffer.data() + size_t(y) * width;
+
+        for (int x = area.x0; x < area.x1; x++) {
+            if (row[x] != FAR_DEPTH) {
+                near_depth = std::min(near_depth, row[x]);
+                far_depth = std::max(far_depth, row[x]);
+            }
+        }
+    }
+
+    if (near_depth == FAR_DEPTH) {
+        return;
     }
 
-    // Two cases for triangle shape once points are sorted
+    double near_w = -1.0 / near_depth, far_w = -1.0 / far_depth;
 
-    int y_start = std::max(0, (int)p1.Y);
-    int y_end = std::min((int)height, (int)p3.Y);
+    // Texels off the map are lit, so an area wholly beyond one of its edges
+    // as seen from the light is too
+    for (int plane = 1; plane < CLIP_PLANES; plane++) {
+        Vector4 edge = clip_plane(plane, SCREEN_EXTENT);
+        Vector4 inside(
+            edge.X * to_light[0].X + edge.Y * to_light[1].X + edge.W * to_light[2].X,
+            edge.X * to_light[0].Y + edge.Y * to_light[1].Y + edge.W * to_light[2].Y,
+            edge.X * to_light[0].Z + edge.Y * to_light[1].Z + edge.W * to_light[2].Z,
+            edge.X * to_light[0].W + edge.Y * to_light[1].W + edge.W * to_light[2].W);
 
-    // p1-p2 line is above p1-p3
-    if (horizontal || dP1P2 > dP1P3) {
-        // Iterate over height of triangle
-        for (auto y = y_start; y <= y_end; y++) {
-            // Reverse once second point is reached
-            if (y < p2.Y) {
-                // Draw line across triangle's width
-                ProcessScanLine(y, p1, p3, p1, p2, color);
-            } else {
-                ProcessScanLine(y, p1, p3, p2, p3, color);
+        double most = inside.Z
+            + std::max(inside.X * clip_x(area.x0), inside.X * clip_x(area.x1 - 1))
+            + std::max(inside.Y * clip_y(area.y0), inside.Y * clip_y(area.y1 - 1));
+
+        if (std::max(most * near_w, most * far_w) + inside.W < 0.0) {
+            return;
+        }
+    }
+
+    for (int y = area.y0; y < area.y1; y++) {
+        double pixel_y = clip_y(y);
+
+        for (int x = area.x0; x < area.x1; x++) {
+            size_t index = size_t(y) * width + x;
+            float depth = depth_buffer[index];
+
+            if (depth == FAR_DEPTH) {
+                continue;
+            }
+
+            double w = -1.0 / depth;
+            double pixel_x = clip_x(x);
+
+            auto apply = [pixel_x, pixel_y, w](const Vector4& f) {
+                return (f.X * pixel_x + f.Y * pixel_y + f.Z) * w + f.W;
+            };
+
+            if (std::abs(apply(height_above)) > RECEIVER_TOLERANCE * w) {
+                continue;
+            }
+
+            float lit = shadow_map.Lit(apply(to_light[0]), apply(to_light[1]), apply(to_light[2]));
+            if (lit >= 1.0f) {
+                continue;
+            }
+
+            // each channel scaled between its full shadow amount and 256
+            uint32_t blocked = uint32_t(256.0f * (1.0f - lit));
+            uint8_t* pixel = color_buffer.data() + 4 * index;
+
+            for (int channel = 0; channel < 3; channel++) {
+                uint32_t amount = 256 - (((256 - shaded[channel]) * blocked) >> 8);
+                pixel[channel] = uint8_t((pixel[channel] * amount) >> 8);
             }
         }
-    } // p1-p3 is above p1-p2
-    else {
-        for (auto y = y_start; y <= y_end; y++) {
-            if (y < p2.Y) {
-                ProcessScanLine(y, p1, p2, p1, p3, color);
-            } else {
-                ProcessScanLine(y, p2, p3, p1, p3, color);
+    }
+}
+
+const std::vector<uint32_t>& RenderDevice::LightFaces(const Lighting& lighting, const RenderMesh& mesh, const Quaternion& rotation, const Vector3& translation) {
+    auto lit = std::find_if(lit_meshes.begin(), lit_meshes.end(), [&mesh](const LitMesh& lit) {
+        return lit.mesh == &mesh;
+    });
+
+    if (lit == lit_meshes.end()) {
+        if (lit_meshes.size() < MAX_LIT_MESHES) {
+            lit = lit_meshes.emplace(lit_meshes.end());
+        } else {
+            lit = lit_meshes.begin() + next_lit_mesh;
+            next_lit_mesh = (next_lit_mesh + 1) % MAX_LIT_MESHES;
+        }
+
+        lit->mesh = &mesh;
+        lit->lighting = nullptr;
+    }
+
+    const Quaternion& pose = lit->rotation;
+    bool moved = pose.R() != rotation.R() || pose.A() != rotation.A() || pose.B() != rotation.B() || pose.C() != rotation.C()
+        || lit->translation.X != translation.X || lit->translation.Y != translation.Y || lit->translation.Z != translation.Z;
+
+    if (moved || lit->lighting != &lighting || lit->lighting_version != lighting.Version()) {
+        LightMesh(lighting, mesh, rotation, translation, lit->colors);
+
+        lit->lighting = &lighting;
+        lit->lighting_version = lighting.Version();
+        lit->rotation = rotation;
+        lit->translation = translation;
+    }
+
+    return lit->colors;
+}
+
+void RenderDevice::LightMesh(const Lighting& lighting, const RenderMesh& mesh, const Quaternion& rotation, const Vector3& translation, std::vector<uint32_t>& colors) {
+    lighting.Model(mesh.Surfaces, rotation, translation, face_colors);
+
+    colors.resize(face_colors.size());
+    for (size_t i = 0; i < face_colors.size(); i++) {
+        colors[i] = face_colors[i].Packed();
+    }
+}
+
+void RenderDevice::TransformVertices(const RenderMesh& mesh, const Matrix& transform) {
+    size_t count = mesh.vertexCount();
+
+    clip_vertices.resize(count);
+    screen_vertices.resize(count);
+    vertex_outcodes.resize(count);
+
+    Vector4 rows[4] = { transform.Row(0), transform.Row(1), transform.Row(2), transform.Row(3) };
+
+#ifdef RENDER_SSE2
+    // Columns of the transform as (x, y) and (z, w) halves, so each vertex is
+    // a sum of columns scaled by its coordinates; the sums are added in the
+    // same order as Matrix's, so results match it exactly
+    __m128d column_xy[4] = {
+        _mm_setr_pd(rows[0].X, rows[1].X), _mm_setr_pd(rows[0].Y, rows[1].Y),
+        _mm_setr_pd(rows[0].Z, rows[1].Z), _mm_setr_pd(rows[0].W, rows[1].W),
+    };
+    __m128d column_zw[4] = {
+        _mm_setr_pd(rows[2].X, rows[3].X), _mm_setr_pd(rows[2].Y, rows[3].Y),
+        _mm_setr_pd(rows[2].Z, rows[3].Z), _mm_setr_pd(rows[2].W, rows[3].W),
+    };
+#endif
+
+    for (size_t i = 0; i < count; i++) {
+        Vector4& clip = clip_vertices[i];
+
+#ifdef RENDER_SSE2
+        __m128d x = _mm_set1_pd(mesh.X[i]);
+        __m128d y = _mm_set1_pd(mesh.Y[i]);
+        __m128d z = _mm_set1_pd(mesh.Z[i]);
+
+        __m128d xy = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(x, column_xy[0]), _mm_mul_pd(y, column_xy[1])),
+            _mm_mul_pd(z, column_xy[2])), column_xy[3]);
+        __m128d zw = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(x, column_zw[0]), _mm_mul_pd(y, column_zw[1])),
+            _mm_mul_pd(z, column_zw[2])), column_zw[3]);
+
+        _mm_storeu_pd(&clip.X, xy);
+        _mm_storeu_pd(&clip.Z, zw);
+#else
+        clip = transform * Vector4(mesh.X[i], mesh.Y[i], mesh.Z[i], 1.0);
+#endif
+
+        int code = outcode(clip, SCREEN_EXTENT) | outcode(clip, GUARD_BAND) << CLIP_PLANES;
+        vertex_outcodes[i] = uint16_t(code);
+
+        // only vertices inside the guard band are ever projected directly
+        if ((code >> CLIP_PLANES) == 0) {
+            screen_vertices[i] = ToScreen(clip);
+        }
+    }
+}
+
+void RenderDevice::ClipTriangle(const Vector4 (&clip)[3], int outside, uint32_t color) {
+    // Clip the polygon against each plane a vertex is outside of, which
+    // adds at most one vertex per plane
+    Vector4 polygon[3 + CLIP_PLANES];
+    Vector4 clipped[3 + CLIP_PLANES];
+    int count = 3;
+
+    std::copy(clip, clip + 3, polygon);
+
+    for (int plane = 0; plane < CLIP_PLANES; plane++) {
+        if ((outside & (1 << plane)) == 0) {
+            continue;
+        }
+
+        Vector4 coefficients = clip_plane(plane, GUARD_BAND);
+        int clipped_count = 0;
+
+        for (int i = 0; i < count; i++) {
+            const Vector4& current = polygon[i];
+            const Vector4& next = polygon[(i + 1) % count];
+
+            double current_distance = Vector4::Dot(coefficients, current);
+            double next_distance = Vector4::Dot(coefficients, next);
+
+            if (current_distance >= 0.0) {
+                clipped[clipped_count++] = current;
+            }
+
+            // edge crosses the plane
+            if ((current_distance >= 0.0) != (next_distance >= 0.0)) {
+                double t = current_distance / (current_distance - next_distance);
+                clipped[clipped_count++] = Vector4::Add(current, Vector4::Multiply(Vector4::Subtract(next, current), t));
             }
         }
+
+        if (clipped_count < 3) {
+            return;
+        }
+
+        std::copy(clipped, clipped + clipped_count, polygon);
+        count = clipped_count;
+    }
+
+    Vector3 first = ToScreen(polygon[0]);
+
+    for (int i = 1; i + 1 < count; i++) {
+        SubmitTriangle(first, ToScreen(polygon[i]), ToScreen(polygon[i + 1]), color);
     }
 }
 
-double RenderDevice::Clamp(double value, double min, double max) {
-    return std::max(min, std::min(value, max));
+void RenderDevice::SubmitTriangle(const Vector3& p1, const Vector3& p2, const Vector3& p3, uint32_t color) {
+    if (pool) {
+        BinTriangle(p1, p2, p3, color);
+    } else {
+        RasterizeTriangle(p1, p2, p3, color, Screen());
+    }
 }
 
-double RenderDevice::Interpolate(double min, double max, double gradient) {
-    return min + ((max - min) * gradient);
+Vector3 RenderDevice::ToScreen(const Vector4& clip) const {
+    // Origin at the top left, y running down. Depth is -1/w rather than the
+    // projected z, which bunches up so close to 1 that a float can't tell
+    // surfaces apart. It orders the same, and is also linear across the screen.
+    return Vector3(width * (clip.X / clip.W + 0.5), height * (-clip.Y / clip.W + 0.5), -1.0 / clip.W);
 }
 
-void RenderDevice::ProcessScanLine(int y, Vector3 pa, Vector3 pb, Vector3 pc, Vector3 pd, Color color) {
-    auto gradient1 = (abs(pa.Y - pb.Y) > epsilon) ? (y - pa.Y) / (pb.Y - pa.Y) : 1;
-    auto gradient2 = (abs(pc.Y - pd.Y) > epsilon) ? (y - pc.Y) / (pd.Y - pc.Y) : 1;
+bool RenderDevice::OutsideView(const Mesh::Sphere& sphere, const Matrix& transform) const {
+    for (int plane = 0; plane < CLIP_PLANES; plane++) {
+        Vector4 coefficients = untransformed_plane(transform, clip_plane(plane, SCREEN_EXTENT));
+
+        Vector3 normal(coefficients.X, coefficients.Y, coefficients.Z);
+        double distance = Vector3::Dot(normal, sphere.center) + coefficients.W;
 
-    int sx = (int)Interpolate(pa.X, pb.X, gradient1);
-    int ex = (int)Interpolate(pc.X, pd.X, gradient2);
+        if (distance < -sphere.radius * Vector3::Length(normal)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RenderDevice::Flush() {
+    if (triangles.empty()) {
+        return;
+    }
 
-    double z1 = Interpolate(pa.Z, pb.Z, gradient1);
-    double z2 = Interpolate(pc.Z, pd.Z, gradient2);
+    // Tiles cover disjoint pixels, so workers share the buffers without locking
+    pool->parallel_for(bins.size(), [this](size_t index) {
+        Tile tile = TileAt(index);
 
-    // drawing a line from left (sx) to right (ex)
-    for (auto x = sx; x < ex; x++) {
-        double gradient = (x - sx) / (double)(ex - sx);
+        for (uint32_t triangle : bins[index]) {
+            const auto& t = triangles[triangle];
+            RasterizeTriangle(t.a, t.b, t.c, t.color, tile);
+        }
+    });
 
-        auto z = Interpolate(z1, z2, gradient);
-        DrawPoint(Vector3(x, y, z), color);
+    triangles.clear();
+    for (auto& bin : bins) {
+        bin.clear();
     }
 }
 
-double delta(int x, int y) {
-    double x2 = x * x;
-    double y2 = y * y;
+void RenderDevice::BinTriangle(const Vector3& p1, const Vector3& p2, const Vector3& p3, uint32_t color) {
+    double min_x = std::min({ p1.X, p2.X, p3.X });
+    double max_x = std::max({ p1.X, p2.X, p3.X });
+    double min_y = std::min({ p1.Y, p2.Y, p3.Y });
+    double max_y = std::max({ p1.Y, p2.Y, p3.Y });
+
+    if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height) {
+        return;
+    }
+
+    int first_x = std::max(0.0, min_x) / TILE_SIZE;
+    int last_x = std::min(width - 1.0, max_x) / TILE_SIZE;
+    int first_y = std::max(0.0, min_y) / TILE_SIZE;
+    int last_y = std::min(height - 1.0, max_y) / TILE_SIZE;
 
-    return sqrt(x2 + y2);
+    uint32_t index = uint32_t(triangles.size());
+    triangles.push_back({ p1, p2, p3, color });
+
+    for (int y = first_y; y <= last_y; y++) {
+        for (int x = first_x; x <= last_x; x++) {
+            bins[size_t(y) * tiles_x + x].push_back(index);
+        }
+    }
 }
 
-void RenderDevice::DrawLine(Vector3 pointA, Vector3 pointB, Color color, int width) {
-    int x0 = (int)pointA.X;
-    int y0 = (int)pointA.Y;
-    int x1 = (int)pointB.X;
-    int y1 = (int)pointB.Y;
-    int x2;
-    int y2;
+RenderDevice::Tile RenderDevice::Screen() const {
+    return { 0, 0, int(width), int(height) };
+}
 
-    int wd = (width + 1) / 2;
+RenderDevice::Tile RenderDevice::TileAt(size_t index) const {
+    int x0 = int(index % tiles_x * TILE_SIZE);
+    int y0 = int(index / tiles_x * TILE_SIZE);
 
-    auto dx = abs(x1 - x0);
-    auto dy = abs(y1 - y0);
-    auto sx = (x0 < x1) ? 1 : -1;
-    auto sy = (y0 < y1) ? 1 : -1;
-    auto err = dx - dy;
-    double ed = dx + dy == 0 ? 1 : delta(dx, dy);
+    return { x0, y0, std::min(x0 + int(TILE_SIZE), int(width)), std::min(y0 + int(TILE_SIZE), int(height)) };
+}
 
-    int x = x0;
-    int y = y0;
+bool RenderDevice::Hidden(const Mesh::Bounds& bounds, const Matrix& transform) {
+    double min_x = std::numeric_limits<double>::max(), max_x = -min_x;
+    double min_y = min_x, max_y = max_x;
+    double min_depth = min_x;
 
-    while (true) {
-        double t = delta(x - x0, y - y0) / delta(dx, dy);
-        double z = Interpolate(pointA.Z, pointB.Z, t);
-        DrawPoint(Vector3(x, y, z), color);
+    for (int corner = 0; corner < 8; corner++) {
+        Vector4 point((corner & 1) ? bounds.max.X : bounds.min.X,
+            (corner & 2) ? bounds.max.Y : bounds.min.Y,
+            (corner & 4) ? bounds.max.Z : bounds.min.Z, 1.0);
+        Vector4 product = transform * point;
 
-        double e2 = err;
-        x2 = x;
-        if (2 * e2 >= -dx) {
-            for (e2 += dy, y2 = y; e2 < ed * wd && (y1 != y2 || dx > dy); e2 += dx) {
-                y2 += sy;
-                DrawPoint(Vector3(x, y2, z), color);
-            }
-            if (x == x1) break;
-            e2 = err; err -= dy; x += sx;
+        // the box reaches behind the camera, so its projection is unbounded
+        if (product.W <= 0.0) {
+            return false;
         }
 
-        if (2 * e2 <= dy) {
-            for (e2 = dx - e2; e2 < ed * wd && (x1 != x2 || dx < dy); e2 += dy) {
-                x2 += sx;
-                DrawPoint(Vector3(x2, y, z), color);
+        double x = width * (product.X / product.W + 0.5);
+        double y = height * (-product.Y / product.W + 0.5);
+
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+        min_depth = std::min(min_depth, -1.0 / product.W);
+    }
+
+    // off screen entirely counts as hidden too
+    if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height) {
+        return true;
+    }
+
+    Tile area = { int(std::max(0.0, min_x)), int(std::max(0.0, min_y)),
+        int(std::min(width - 1.0, max_x)) + 1, int(std::min(height - 1.0, max_y)) + 1 };
+
+    return hidden(min_depth, MaxDepth(area));
+}
+
+float RenderDevice::MaxDepth(const Tile& area) {
+    float max_depth = -FAR_DEPTH;
+
+    for (int ty = area.y0 / int(TILE_SIZE); ty <= (area.y1 - 1) / int(TILE_SIZE); ty++) {
+        for (int tx = area.x0 / int(TILE_SIZE); tx <= (area.x1 - 1) / int(TILE_SIZE); tx++) {
+            size_t tile = size_t(ty) * tiles_x + tx;
+
+            // nothing drawn there since the clear
+            if (tile_generation[tile] != generation) {
+                return FAR_DEPTH;
+            }
+
+            if (tile_stale[tile]) {
+                // the tile's blocks, clipped to the screen
+                int bx0 = tx * (TILE_SIZE / BLOCK_SIZE), by0 = ty * (TILE_SIZE / BLOCK_SIZE);
+                int bx1 = std::min<int>(bx0 + TILE_SIZE / BLOCK_SIZE, blocks_x);
+                int by1 = std::min<int>(by0 + TILE_SIZE / BLOCK_SIZE, blocks_y);
+
+                float tile_max = -FAR_DEPTH;
+                for (int by = by0; by < by1; by++) {
+                    for (int bx = bx0; bx < bx1; bx++) {
+                        tile_max = std::max(tile_max, block_depth[size_t(by) * blocks_x + bx]);
+                    }
+                }
+
+                tile_depth[tile] = tile_max;
+                tile_stale[tile] = 0;
             }
-            if (y == y1) break;
-            err += dx; y += sy;
+
+            max_depth = std::max(max_depth, tile_depth[tile]);
+        }
+    }
+
+    return max_depth;
+}
+
+void RenderDevice::UpdateBlockDepth(int bx, int by) {
+    int x1 = std::min<int>(bx + BLOCK_SIZE, width);
+    int y1 = std::min<int>(by + BLOCK_SIZE, height);
+    float block_max = -FAR_DEPTH;
+
+    for (int y = by; y < y1; y++) {
+        const float* row = depth_buffer.data() + size_t(y) * width;
+
+        for (int x = bx; x < x1; x++) {
+            block_max = std::max(block_max, row[x]);
         }
     }
+
+    block_depth[size_t(by / BLOCK_SIZE) * blocks_x + bx / BLOCK_SIZE] = block_max;
+    tile_stale[size_t(by / TILE_SIZE) * tiles_x + bx / TILE_SIZE] = 1;
 }
 
-void RenderDevice::DrawPoint(Vector3 point, Color color) {
-    // Clip to device size
-    if (point.X < 0 || point.Y < 0 || point.X >= width || point.Y >= height) {
+void RenderDevice::RasterizeTriangle(Vector3 p1, Vector3 p2, Vector3 p3, uint32_t color, const Tile& clip) {
+    const Vector3* points[3] = { &p1, &p2, &p3 };
+    int64_t x[3], y[3];
+    double z[3];
+
+    for (int i = 0; i < 3; i++) {
+        if (!std::isfinite(points[i]->X) || !std::isfinite(points[i]->Y)) {
+            return;
+        }
+
+        x[i] = std::llround(points[i]->X * SUBPIXEL_ONE);
+        y[i] = std::llround(points[i]->Y * SUBPIXEL_ONE);
+        z[i] = points[i]->Z;
+    }
+
+    // Either winding is drawn; make it the one edge functions are positive in
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+
+    if (area == 0) {
         return;
     }
 
-    auto index = (int)point.X + ((int)point.Y * width);
+    if (area < 0) {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+    }
 
-    if (point.Z > depth_buffer[index]) {
+    // Pixels whose centers can be covered, within the clip
+    int first_x = std::max<int64_t>(clip.x0, (std::min({ x[0], x[1], x[2] }) - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS);
+    int last_x = std::min<int64_t>(clip.x1 - 1, (std::max({ x[0], x[1], x[2] }) - SUBPIXEL_HALF) >> SUBPIXEL_BITS);
+    int first_y = std::max<int64_t>(clip.y0, (std::min({ y[0], y[1], y[2] }) - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS);
+    int last_y = std::min<int64_t>(clip.y1 - 1, (std::max({ y[0], y[1], y[2] }) - SUBPIXEL_HALF) >> SUBPIXEL_BITS);
+
+    if (first_x > last_x || first_y > last_y) {
         return;
     }
 
-    depth_buffer[index] = point.Z;
+    // Reject the whole triangle if everything it could cover is nearer
+    double min_depth = std::min({ z[0], z[1], z[2] });
+
+    if (hidden(min_depth, MaxDepth({ first_x, first_y, last_x + 1, last_y + 1 }))) {
+        return;
+    }
+
+    Edge edges[3] = {
+        make_edge(x[1], y[1], x[2], y[2]),
+        make_edge(x[2], y[2], x[0], y[0]),
+        make_edge(x[0], y[0], x[1], y[1]),
+    };
+
+    // Depth is linear in screen space; z(px, py) = z_origin + dz_dx*px + dz_dy*py
+    // at pixel centers, from the snapped vertices
+    double x0 = double(x[0]) / SUBPIXEL_ONE, y0 = double(y[0]) / SUBPIXEL_ONE;
+    double dx1 = double(x[1] - x[0]) / SUBPIXEL_ONE, dy1 = double(y[1] - y[0]) / SUBPIXEL_ONE;
+    double dx2 = double(x[2] - x[0]) / SUBPIXEL_ONE, dy2 = double(y[2] - y[0]) / SUBPIXEL_ONE;
+    double det = dx1 * dy2 - dx2 * dy1;
+
+    double dz_dx = ((z[1] - z[0]) * dy2 - (z[2] - z[0]) * dy1) / det;
+    double dz_dy = ((z[2] - z[0]) * dx1 - (z[1] - z[0]) * dx2) / det;
+    double z_origin = z[0] + dz_dx * (0.5 - x0) + dz_dy * (0.5 - y0);
+
+    // Blocks are aligned to the screen so every pixel's depth is computed the
+    // same way whichever clip it is drawn through; clips start on block edges
+    int block_x0 = first_x & ~(BLOCK_SIZE - 1);
+    int block_y0 = first_y & ~(BLOCK_SIZE - 1);
+
+    for (int by = block_y0; by <= last_y; by += BLOCK_SIZE) {
+        for (int bx = block_x0; bx <= last_x; bx += BLOCK_SIZE) {
+            int32_t w_start[3], step_x[3], step_y[3];
+            bool outside = false;
+
+            for (int e = 0; e < 3; e++) {
+                const Edge& edge = edges[e];
+
+                int64_t w = edge.a * (int64_t(bx) * SUBPIXEL_ONE + SUBPIXEL_HALF)
+                    + edge.b * (int64_t(by) * SUBPIXEL_ONE + SUBPIXEL_HALF) + edge.c;
+                int64_t across = edge.a * SUBPIXEL_ONE * (BLOCK_SIZE - 1);
+                int64_t down = edge.b * SUBPIXEL_ONE * (BLOCK_SIZE - 1);
+
+                int64_t w_min = w + std::min<int64_t>(across, 0) + std::min<int64_t>(down, 0);
+                int64_t w_max = w + std::max<int64_t>(across, 0) + std::max<int64_t>(down, 0);
+
+                if (w_max < 0) {
+                    outside = true;
+                    break;
+                }
+
+                if (w_min >= 0) {
+                    // covers the whole block, so it never needs testing
+                    w_start[e] = 0;
+                    step_x[e] = 0;
+                    step_y[e] = 0;
+                } else {
+                    w_start[e] = int32_t(w);
+                    step_x[e] = int32_t(edge.a * SUBPIXEL_ONE);
+                    step_y[e] = int32_t(edge.b * SUBPIXEL_ONE);
+                }
+            }
+
+            if (outside) {
+                continue;
+            }
+
+            TouchTile(size_t(by / TILE_SIZE) * tiles_x + bx / TILE_SIZE);
 
-    PutPixel((int)point.X, (int)point.Y, color);
+            // nearest the triangle's plane gets within the block, but no
+            // nearer than the triangle itself
+            double block_min_depth = z_origin + dz_dx * bx + dz_dy * by
+                + std::min(0.0, dz_dx * (BLOCK_SIZE - 1)) + std::min(0.0, dz_dy * (BLOCK_SIZE - 1));
+            block_min_depth = std::max(block_min_depth, min_depth);
+
+            if (hidden(block_min_depth, block_depth[size_t(by / BLOCK_SIZE) * blocks_x + bx / BLOCK_SIZE])) {
+                continue;
+            }
+
+            bool written = false;
+
+            int row_end = std::min(by + BLOCK_SIZE, clip.y1);
+            int column_end = std::min(bx + BLOCK_SIZE, clip.x1);
+
+            for (int py = by; py < row_end; py++) {
+                int32_t w0 = w_start[0], w1 = w_start[1], w2 = w_start[2];
+                double depth = z_origin + dz_dx * bx + dz_dy * py;
+
+                for (int px = bx; px < column_end; px += 4) {
+                    int lanes = std::min(4, column_end - px);
+                    size_t index = size_t(px) + size_t(py) * width;
+
+                    if (lanes == 4) {
+                        written |= ShadeQuad(index, w0, w1, w2, step_x, float(depth), float(dz_dx), color);
+                    } else {
+                        for (int lane = 0; lane < lanes; lane++) {
+                            int32_t coverage = (w0 + lane * step_x[0]) | (w1 + lane * step_x[1]) | (w2 + lane * step_x[2]);
+                            written |= ShadePixel(index + lane, coverage >= 0, float(depth) + float(lane) * float(dz_dx), color);
+                        }
+                    }
+
+                    w0 += 4 * step_x[0];
+                    w1 += 4 * step_x[1];
+                    w2 += 4 * step_x[2];
+                    depth += 4 * dz_dx;
+                }
+
+                w_start[0] += step_y[0];
+                w_start[1] += step_y[1];
+                w_start[2] += step_y[2];
+            }
+
+            if (written) {
+                UpdateBlockDepth(bx, by);
+            }
+        }
+    }
 }
 
-void RenderDevice::PutPixel(int x, int y, Color color) {
-    // As we have a 1D Array for our back buffer
-    // we need to know the equivalent cell in 1D based
-    // on the 2D coordinates on screen
-    auto index = 4 * (x + y * width);
+bool RenderDevice::ShadeQuad(size_t index, int32_t w0, int32_t w1, int32_t w2, const int32_t* step_x,
+    float depth, float dz_dx, uint32_t color) {
+#ifdef RENDER_SSE2
+    // lane * step, as SSE2 has no 32 bit multiply
+    auto offsets = [](int32_t step) {
+        return _mm_setr_epi32(0, step, 2 * step, 3 * step);
+    };
+
+    __m128i e0 = _mm_add_epi32(_mm_set1_epi32(w0), offsets(step_x[0]));
+    __m128i e1 = _mm_add_epi32(_mm_set1_epi32(w1), offsets(step_x[1]));
+    __m128i e2 = _mm_add_epi32(_mm_set1_epi32(w2), offsets(step_x[2]));
+
+    // inside all three edges when no sign bit is set
+    __m128i covered = _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(e0, e1), e2), _mm_set1_epi32(-1));
+
+    if (_mm_movemask_epi8(covered) == 0) {
+        return false;
+    }
+
+    float* depth_row = depth_buffer.data() + index;
+    __m128 z = _mm_add_ps(_mm_set1_ps(depth), _mm_setr_ps(0.0f, dz_dx, 2.0f * dz_dx, 3.0f * dz_dx));
+    __m128 stored = _mm_loadu_ps(depth_row);
+    __m128 mask = _mm_and_ps(_mm_castsi128_ps(covered), _mm_cmple_ps(z, stored));
+
+    int lanes = _mm_movemask_ps(mask);
+
+    if (lanes == 0) {
+        return false;
+    }
+
+    _mm_storeu_ps(depth_row, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, stored)));
+
+    __m128i* pixels = reinterpret_cast<__m128i*>(color_buffer.data() + 4 * index);
+    __m128i current = _mm_loadu_si128(pixels);
+    __m128i fill = _mm_set1_epi32(int32_t(color));
+    __m128i pixel_mask = _mm_castps_si128(mask);
+
+    if (!opaque(color)) {
+        fill = blend(fill, current, color >> 24);
+    }
+
+    _mm_storeu_si128(pixels, _mm_or_si128(_mm_and_si128(pixel_mask, fill), _mm_andnot_si128(pixel_mask, current)));
+
+    return true;
+#else
+    bool written = false;
+
+    for (int i = 0; i < 4; i++) {
+        int32_t coverage = (w0 + i * step_x[0]) | (w1 + i * step_x[1]) | (w2 + i * step_x[2]);
+        written |= ShadePixel(index + i, coverage >= 0, depth + float(i) * dz_dx, color);
+    }
+
+    return written;
+#endif
+}
+
+bool RenderDevice::ShadePixel(size_t index, bool covered, float depth, uint32_t color) {
+    if (!covered || depth > depth_buffer[index]) {
+        return false;
+    }
+
+    depth_buffer[index] = depth;
+    PutPixel(index, color);
+
+    return true;
+}
+
+void RenderDevice::DrawLine(const Vector3& a, const Vector3& b, uint32_t color, double half_width, const Tile& clip) {
+    double dx = b.X - a.X, dy = b.Y - a.Y;
+    double length = std::sqrt(dx * dx + dy * dy);
+
+    if (length == 0.0) {
+        return;
+    }
+
+    double ux = dx / length, uy = dy / length;
+    double dz = (b.Z - a.Z) / length;
+
+    // Pixels whose centers are within half a pixel of the line's edges or
+    // ends are partly covered
+    double reach = half_width + 0.5;
+
+    // Shrinks [first, last] to the x where value + slope * x is strictly
+    // between low and high, given 1 / slope
+    auto limit = [](double value, double slope, double inverse_slope, double low, double high, double& first, double& last) {
+        if (low >= high) {
+            last = first - 1.0;
+            return;
+        }
+
+        if (slope == 0.0) {
+            if (value <= low || value >= high) {
+                last = first - 1.0;
+            }
+            return;
+        }
+
+        double x0 = (low - value) * inverse_slope, x1 = (high - value) * inverse_slope;
+        first = std::max(first, std::min(x0, x1));
+        last = std::min(last, std::max(x0, x1));
+    };
+
+    double inverse_ux = ux != 0.0 ? 1.0 / ux : 0.0;
+    double inverse_uy = uy != 0.0 ? -1.0 / uy : 0.0;
+
+    int y0 = std::max(clip.y0, int(std::floor(std::min(a.Y, b.Y) - reach)));
+    int y1 = std::min(clip.y1, int(std::ceil(std::max(a.Y, b.Y) + reach)) + 1);
+
+    double min_z = std::min(a.Z, b.Z), max_z = std::max(a.Z, b.Z);
+
+    for (int y = y0; y < y1; y++) {
+        // Distances of a pixel center (px, py), relative to a, across and
+        // along the line are linear in px:
+        // across = ux * py - uy * px, along = uy * py + ux * px
+        double py = y + 0.5 - a.Y;
+        double first = clip.x0 + 0.5 - a.X, last = clip.x1 - 0.5 - a.X;
+
+        limit(ux * py, -uy, inverse_uy, -reach, reach, first, last);
+        limit(uy * py, ux, inverse_ux, -0.5, length + 0.5, first, last);
+
+        int x_first = std::max(clip.x0, int(std::ceil(first + a.X - 0.5)));
+        int x_last = std::min(clip.x1 - 1, int(std::floor(last + a.X - 0.5)));
+
+        if (x_first > x_last) {
+            continue;
+        }
+
+        for (int tile_x = x_first / int(TILE_SIZE); tile_x <= x_last / int(TILE_SIZE); tile_x++) {
+            TouchTile(size_t(y) / TILE_SIZE * tiles_x + tile_x);
+        }
+
+        // Pixels partly covered, near the line's edges and ends. Everything is
+        // worked out from x alone, so each tile draws its part the same.
+        double across_y = ux * py, along_y = uy * py;
+
+        auto shade_partial = [&](int x_begin, int x_end) {
+            size_t index = size_t(y) * width + x_begin;
+
+            for (int x = x_begin; x < x_end; x++, index++) {
+                double px = x + 0.5 - a.X;
+                double across = across_y - uy * px;
+                double along = along_y + ux * px;
+
+                double side = std::min(1.0, reach - std::abs(across));
+                double end = std::min(1.0, 0.5 + std::min(along, length - along));
+
+                if (side <= 0.0 || end <= 0.0) {
+                    continue;
+                }
+
+                // Screen depth is linear along the line
+                float depth = float(std::min(max_z, std::max(min_z, a.Z + dz * along)));
+
+                if (depth > depth_buffer[index]) {
+                    continue;
+                }
+
+                // Only fully covered pixels hide what's drawn behind them later
+                uint32_t amount = uint32_t(side * end * 256.0 + 0.5);
+
+                if (amount >= 256) {
+                    depth_buffer[index] = depth;
+                    PutPixel(index, color);
+                } else if (amount > 0) {
+                    PutPixel(index, fade(color, amount));
+                }
+            }
+        };
+
+        // The pixels between are covered fully, so are shaded like a
+        // triangle's, four at a time
+        double inner_first = first, inner_last = last;
+        limit(ux * py, -uy, inverse_uy, 1.0 - reach, reach - 1.0, inner_first, inner_last);
+        limit(uy * py, ux, inverse_ux, 0.5, length - 0.5, inner_first, inner_last);
+
+        int inner_begin = std::max(x_first, int(std::ceil(inner_first + a.X - 0.5)));
+        int inner_end = std::min(x_last + 1, int(std::floor(inner_last + a.X - 0.5)) + 1);
+
+        if (inner_begin >= inner_end) {
+            shade_partial(x_first, x_last + 1);
+            continue;
+        }
+
+        shade_partial(x_first, inner_begin);
+
+        auto depth_at = [&](int x) {
+            return float(a.Z + dz * (along_y + ux * (x + 0.5 - a.X)));
+        };
+
+        // quads start at multiples of four, wherever the tile's edge falls
+        float dz_dx = float(dz * ux);
+        int x = inner_begin;
+
+        for (; x < inner_end && x % 4 != 0; x++) {
+            ShadePixel(size_t(y) * width + x, true, depth_at(x), color);
+        }
+
+        for (; x + 4 <= inner_end; x += 4) {
+            ShadeQuad(size_t(y) * width + x, 0, 0, 0, FULL_COVERAGE, depth_at(x), dz_dx, color);
+        }
+
+        for (; x < inner_end; x++) {
+            ShadePixel(size_t(y) * width + x, true, depth_at(x), color);
+        }
+
+        shade_partial(inner_end, x_last + 1);
+    }
+}
+
+void RenderDevice::PutPixel(size_t index, uint32_t color) {
+    uint8_t* pixel = color_buffer.data() + 4 * index;
+
+    if (!opaque(color)) {
+        uint32_t destination;
+        std::memcpy(&destination, pixel, 4);
+        color = blend(color, destination);
+    }
 
-    color_buffer[index + 0] = (char)((color.Alpha)*(color.Blue * 255)) + (char)((1.0 - color.Alpha) * (double)color_buffer[index]);
-    color_buffer[index + 1] = (char)((color.Alpha)*(color.Green * 255)) + (char)((1.0 - color.Alpha) * (double)color_buffer[index + 1]);
-    color_buffer[index + 2] = (char)((color.Alpha)*(color.Red * 255)) + (char)((1.0 - color.Alpha) * (double)color_buffer[index + 2]);
-    color_buffer[index + 3] = (char)std::max(color.Alpha * 255.0, (double)color_buffer[index + 3]);
+    std::memcpy(pixel, &color, 4);
 }
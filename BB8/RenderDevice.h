@@ -1,58 +1,238 @@
 #pragma once
 
-#include <tuple>
+#include <cstdint>
 #include <vector>
 
+#ifdef _WIN32
 #include "framework.h"
+#endif
 
 #include "Camera.h"
 #include "Color.h"
+#include "InstanceIndex.h"
 #include "Lighting.h"
 #include "Mesh.h"
 #include "Quaternion.h"
+#include "RenderMesh.h"
+#include "ShadowMap.h"
+#include "ThreadPool.h"
 #include "Vector3.h"
 
 class RenderDevice {
 public:
+    // One posed copy of a mesh
+    class Instance {
+    public:
+        Quaternion rotation = Quaternion::Identity();
+        Vector3 translation;
+    };
+
     RenderDevice();
-    RenderDevice(UINT32 pixelWidth, UINT32 pixelHeight);
+
+    // With a thread pool, surfaces are binned into screen tiles and only
+    // rasterized, one tile per task, by Flush
+    RenderDevice(uint32_t pixelWidth, uint32_t pixelHeight, ThreadPool* pool = nullptr);
 
     // This method is called to clear the back buffer with a specific color
     void Clear(Color fillColor);
 
+#ifdef _WIN32
     // Once scene is rendered, use to present scene to render target
     HRESULT PresentTo(ID2D1HwndRenderTarget* render_target) const;
+#endif
 
-    void RenderSurface(const Camera& camera, const Lighting& lighting, const Mesh& mesh, const Quaternion& rotation, const Vector3& translation);
-    void RenderWireframe(const Camera& camera, const Mesh& mesh, const Quaternion& rotation, const Vector3& translation, const Color& color, int thickness);
-
-private:
-    std::vector<uint8_t> color_buffer;
-    std::vector<double> depth_buffer;
-    std::vector<double> shadow_buffer;
-
-    UINT32 width, height;
+    uint32_t Width() const;
+    uint32_t Height() const;
 
-    // Project transform coordinate and projects to screen-space
-    std::tuple<bool, Vector3> Project(const Vector3& coord, const Matrix& camera_transform) const;
+    // Rendered scene, 4 bytes per pixel in BGRA order, rows top to bottom
+    const std::vector<uint8_t>& ColorBuffer() const;
 
-    void RasterizeTriangle(Vector3 p1, Vector3 p2, Vector3 p3, Color color);
+    void RenderSurface(const Camera& camera, const Lighting& lighting, const RenderMesh& mesh, const Quaternion& rotation, const Vector3& translation);
+    // Draws the mesh once per instance, nearest first, skipping instances
+    // outside the view without visiting each
+    void RenderInstances(const Camera& camera, const Lighting& lighting, const RenderMesh& mesh, const std::vector<Instance>& instances);
 
-    // Draw scan line at y in triangle formed by pa, pb, and pc
-    void ProcessScanLine(int y, Vector3 pa, Vector3 pb, Vector3 pc, Vector3 pd, Color color);
+    void RenderWireframe(const Camera& camera, const RenderMesh& mesh, const Quaternion& rotation, const Vector3& translation, const Color& color, int thickness);
 
-    // Clamps value between min and max
-    double Clamp(double value, double min = 0, double max = 1);
+    // Darkens what's drawn on the receiver plane, X·x + Y·y + Z·z + W = 0,
+    // where the map's caster keeps the light off it. Call once the surfaces
+    // are drawn and before anything translucent.
+    void RenderShadow(const Camera& camera, const ShadowMap& shadow_map, const Vector4& receiver);
 
-    // Interpolates gradient between min and max
-    double Interpolate(double min, double max, double gradient);
+    // Rasterizes any binned surfaces; call once the scene is drawn
+    void Flush();
 
-    // Draws a line between point A and point B using modified Bresenham's algorithm
-    void DrawLine(Vector3 pointA, Vector3 pointB, Color color, int width);
+    // Keeps a copy of the color and depth drawn so far, e.g. of what doesn't
+    // move, for later frames to start from instead of clearing. The key,
+    // never 0, tells copies apart.
+    void SaveLayer(uint64_t key);
+    // Whether the copy kept is the one saved with the key
+    bool HasLayer(uint64_t key) const;
+    // Starts a frame from the copy kept, as Clear does from a color. Only
+    // call once one is kept.
+    void RestoreLayer();
 
-    // DrawPoint calls PutPixel but does the clipping operation before
-    void DrawPoint(Vector3 point, Color color);
+private:
+    // a multiple of the rasterizer's block size
+    static constexpr uint32_t TILE_SIZE = 64;
+
+    // Pixels x0 <= x < x1, y0 <= y < y1 that a rasterization may touch
+    class Tile {
+    public:
+        int x0, y0, x1, y1;
+    };
+
+    // Projected and lit triangle waiting in its tiles' bins
+    class Triangle {
+    public:
+        Vector3 a, b, c;
+        uint32_t color;
+    };
 
-    // Called to put a pixel on screen at a specific X,Y coordinates
-    void PutPixel(int x, int y, Color color);
+    std::vector<uint8_t> color_buffer;
+    std::vector<float> depth_buffer;
+
+    uint32_t width, height;
+
+    ThreadPool* pool;
+    uint32_t tiles_x, tiles_y;
+    uint32_t blocks_x, blocks_y;
+
+    // Depth pyramid: the farthest depth stored in each rasterizer block,
+    // and in each tile, which is refreshed from its blocks when next needed.
+    // Both only ever overestimate, so whatever is farther is surely hidden.
+    std::vector<float> block_depth;
+    std::vector<float> tile_depth;
+    std::vector<uint8_t> tile_stale;
+
+    // Clear counts frames; a tile's depth, in the buffer and the pyramid,
+    // only counts as drawn to if its generation is the current one
+    uint32_t generation = 0;
+    std::vector<uint32_t> tile_generation;
+
+    // The copy of the buffers and depth pyramid kept by SaveLayer
+    class Layer {
+    public:
+        uint64_t key = 0;
+
+        std::vector<uint8_t> color_buffer;
+        std::vector<float> depth_buffer;
+        std::vector<float> block_depth;
+        std::vector<float> tile_depth;
+        std::vector<uint8_t> tile_stale;
+    };
+
+    Layer layer;
+
+    // indices into triangles in submission order, so blending within each
+    // tile happens in the same order as drawing serially
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> bins;
+
+    // A wireframe's edges on screen, binned like triangles while it's drawn
+    class Line {
+    public:
+        Vector3 a, b;
+    };
+
+    std::vector<Line> lines;
+
+    // The mesh being drawn's vertices in clip space, on screen where inside
+    // the guard band, and the planes each is outside of; reused between draws
+    std::vector<Vector4> clip_vertices;
+    std::vector<Vector3> screen_vertices;
+    std::vector<uint16_t> vertex_outcodes;
+
+    // A mesh's faces as lit in the pose it was last drawn in
+    class LitMesh {
+    public:
+        const RenderMesh* mesh = nullptr;
+
+        const Lighting* lighting = nullptr;
+        uint64_t lighting_version = 0;
+        Quaternion rotation = Quaternion::Identity();
+        Vector3 translation;
+
+        // packed, see Color::Packed
+        std::vector<uint32_t> colors;
+    };
+
+    static constexpr size_t MAX_LIT_MESHES = 16;
+
+    std::vector<LitMesh> lit_meshes;
+    size_t next_lit_mesh = 0;
+    std::vector<Color> face_colors;
+
+    // Instances being drawn: their bounds, an index over them, the ones in
+    // view, and the colors of the one being drawn
+    std::vector<Mesh::Sphere> instance_bounds;
+    InstanceIndex instance_index;
+    std::vector<Vector4> view_planes;
+    std::vector<uint32_t> visible_instances;
+    std::vector<uint32_t> instance_colors;
+
+    void ClearRows(size_t first_row, size_t end_row, uint32_t fill);
+    void RestoreRows(size_t first_row, size_t end_row);
+    // Clears the tile's depth if it hasn't been drawn to since the last Clear
+    void TouchTile(size_t tile);
+    // Draws a posed mesh unless it's hidden by what's drawn; lighting kept
+    // is only redone once the pose or lights change
+    void DrawSurface(const Matrix& transform, const Vector3& camera_position, const Lighting& lighting, const RenderMesh& mesh,
+        const Quaternion& rotation, const Vector3& translation, bool keep_lighting);
+
+    // Packed colors of the mesh's faces in the pose
+    void LightMesh(const Lighting& lighting, const RenderMesh& mesh, const Quaternion& rotation, const Vector3& translation, std::vector<uint32_t>& colors);
+
+    // Colors of the mesh's faces, relit only if its pose or the lights changed
+    const std::vector<uint32_t>& LightFaces(const Lighting& lighting, const RenderMesh& mesh, const Quaternion& rotation, const Vector3& translation);
+
+    // Transforms every vertex once for the faces or edges that share them
+    void TransformVertices(const RenderMesh& mesh, const Matrix& transform);
+
+    // Clips a triangle given in clip space to the guard band planes in
+    // outside, then hands it on for rasterizing
+    void ClipTriangle(const Vector4 (&clip)[3], int outside, uint32_t color);
+    void SubmitTriangle(const Vector3& p1, const Vector3& p2, const Vector3& p3, uint32_t color);
+    Vector3 ToScreen(const Vector4& clip) const;
+
+    // Whether the sphere is entirely outside the view
+    bool OutsideView(const Mesh::Sphere& sphere, const Matrix& transform) const;
+
+    void BinTriangle(const Vector3& p1, const Vector3& p2, const Vector3& p3, uint32_t color);
+    Tile Screen() const;
+    Tile TileAt(size_t index) const;
+
+    // Whether the box would be entirely behind what's drawn, or off screen
+    bool Hidden(const Mesh::Bounds& bounds, const Matrix& transform);
+
+    // Farthest depth stored in the tiles overlapping area
+    float MaxDepth(const Tile& area);
+    void UpdateBlockDepth(int bx, int by);
+
+    // Fills pixels whose centers the triangle covers, by edge functions
+    // evaluated at subpixel precision, with the top-left fill rule
+    void RasterizeTriangle(Vector3 p1, Vector3 p2, Vector3 p3, uint32_t color, const Tile& clip);
+
+    // Depth tests and fills four consecutive pixels of a row, given edge
+    // values at the first and their steps per pixel, returning whether any
+    // were written. Colors are packed, see Color::Packed.
+    bool ShadeQuad(size_t index, int32_t w0, int32_t w1, int32_t w2, const int32_t* step_x,
+        float depth, float dz_dx, uint32_t color);
+    bool ShadePixel(size_t index, bool covered, float depth, uint32_t color);
+
+    // Draws a line between screen points a and b, half_width pixels to
+    // either side, blending in each pixel the fraction of it covered. Depth
+    // is tested per pixel but only written where covered fully, so the
+    // translucent fringes of lines don't hide each other.
+    void DrawLine(const Vector3& a, const Vector3& b, uint32_t color, double half_width, const Tile& clip);
+
+    // Scales the colors of the area's pixels in the shadow that are on the
+    // receiver, given their height above it and light clip coordinates as
+    // functions of their own clip coordinates
+    void ShadeShadow(const Tile& area, const ShadowMap& shadow_map, const Vector4& height_above,
+        const Vector4 (&to_light)[3], const uint32_t (&shaded)[3]);
+
+    // Stores an opaque packed color at the pixel, or blends a translucent one
+    // over it
+    void PutPixel(size_t index, uint32_t color);
 };
@@ -0,0 +1,106 @@
+#include "RenderMesh.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+namespace {
+
+// The mesh's edges with vertices at the same place welded, e.g. the ring of
+// vertices Robot puts at each pole, each edge once and none of no length
+std::vector<std::pair<size_t, size_t>> welded_edges(const Mesh& mesh, const Mesh::Bounds& bounds) {
+    // positions are compared snapped to a millionth of the mesh's size
+    double size = std::max({ bounds.max.X - bounds.min.X, bounds.max.Y - bounds.min.Y, bounds.max.Z - bounds.min.Z });
+    double step = size > 0.0 ? size * 1e-6 : 1.0;
+
+    std::vector<std::pair<std::array<int64_t, 3>, size_t>> positions;
+    positions.reserve(mesh.Vertices.size());
+
+    for (size_t i = 0; i < mesh.Vertices.size(); i++) {
+        const Vector3& vertex = mesh.Vertices[i];
+        positions.push_back({ { std::llround(vertex.X / step), std::llround(vertex.Y / step), std::llround(vertex.Z / step) }, i });
+    }
+
+    std::sort(positions.begin(), positions.end());
+
+    // every vertex stands for the first at its place
+    std::vector<size_t> weld(mesh.Vertices.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        bool same = i > 0 && positions[i].first == positions[i - 1].first;
+        weld[positions[i].second] = same ? weld[positions[i - 1].second] : positions[i].second;
+    }
+
+    std::vector<std::pair<size_t, size_t>> edges;
+    edges.reserve(mesh.Edges.size());
+
+    for (const auto& edge : mesh.Edges) {
+        size_t a = weld[edge.first], b = weld[edge.second];
+
+        if (a != b) {
+            edges.push_back({ std::min(a, b), std::max(a, b) });
+        }
+    }
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    return edges;
+}
+
+}
+
+size_t RenderMesh::IndexBuffer::size() const {
+    return Short.size() + Long.size();
+}
+
+RenderMesh::RenderMesh() : Closed(false) {
+    BoundingSphere.radius = 0.0;
+}
+
+RenderMesh::RenderMesh(const Mesh& mesh)
+    : Surfaces(mesh),
+    Bounds(mesh.computeBounds()),
+    BoundingSphere(mesh.computeBoundingSphere()),
+    Closed(mesh.Closed) {
+    X.reserve(mesh.Vertices.size());
+    Y.reserve(mesh.Vertices.size());
+    Z.reserve(mesh.Vertices.size());
+
+    for (const auto& vertex : mesh.Vertices) {
+        X.push_back(float(vertex.X));
+        Y.push_back(float(vertex.Y));
+        Z.push_back(float(vertex.Z));
+    }
+
+    bool narrow = mesh.Vertices.size() <= size_t(std::numeric_limits<uint16_t>::max()) + 1;
+
+    auto add = [narrow](IndexBuffer& buffer, size_t index) {
+        if (narrow) {
+            buffer.Short.push_back(uint16_t(index));
+        } else {
+            buffer.Long.push_back(uint32_t(index));
+        }
+    };
+
+    for (const auto& face : mesh.Faces) {
+        add(Triangles, face.A);
+        add(Triangles, face.B);
+        add(Triangles, face.C);
+    }
+
+    for (const auto& edge : welded_edges(mesh, Bounds)) {
+        add(Lines, edge.first);
+        add(Lines, edge.second);
+    }
+}
+
+size_t RenderMesh::vertexCount() const {
+    return X.size();
+}
+
+size_t RenderMesh::faceCount() const {
+    return Triangles.size() / 3;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Lighting.h"
+#include "Mesh.h"
+
+// A mesh laid out for drawing: float positions one array per coordinate,
+// indices as narrow as the vertex count allows, and face data as lighting
+// reads it. It copies what it needs from a Mesh, so later edits to the Mesh
+// don't reach it. Its fields are plain data, but the renderer and shadow map
+// cache per mesh by address: replace a mesh once drawn rather than edit it.
+class RenderMesh {
+public:
+    // Vertex indices, 16 bits wide when every vertex fits
+    class IndexBuffer {
+    public:
+        std::vector<uint16_t> Short;
+        std::vector<uint32_t> Long;
+
+        size_t size() const;
+    };
+
+    std::vector<float> X, Y, Z;
+
+    // three per face, and two per edge. Edges are welded: each is listed
+    // once, between the first of any vertices sharing a position.
+    IndexBuffer Triangles;
+    IndexBuffer Lines;
+
+    Lighting::Surfaces Surfaces;
+
+    Mesh::Bounds Bounds;
+    Mesh::Sphere BoundingSphere;
+    bool Closed;
+
+    RenderMesh();
+    RenderMesh(const Mesh& mesh);
+
+    size_t vertexCount() const;
+    size_t faceCount() const;
+};
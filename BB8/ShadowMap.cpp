@@ -0,0 +1,222 @@
+#include "ShadowMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Depth stored for texels no part of the caster covers
+constexpr float FAR_DEPTH = std::numeric_limits<float>::max();
+
+}
+
+ShadowMap::ShadowMap(uint32_t size) : size(size) {}
+
+void ShadowMap::Update(const Lighting::Light& light, const RenderMesh& caster, const Quaternion& rotation, const Vector3& translation) {
+    bool unchanged = this->caster == &caster
+        && this->rotation.R() == rotation.R() && this->rotation.A() == rotation.A()
+        && this->rotation.B() == rotation.B() && this->rotation.C() == rotation.C()
+        && this->translation.X == translation.X && this->translation.Y == translation.Y && this->translation.Z == translation.Z
+        && this->light.position.X == light.position.X && this->light.position.Y == light.position.Y && this->light.position.Z == light.position.Z;
+
+    this->light = light;
+
+    if (unchanged) {
+        return;
+    }
+
+    this->caster = &caster;
+    this->rotation = rotation;
+    this->translation = translation;
+    version++;
+
+    caster_bounds.center = Vector3::Add(rotation.Rotate(caster.BoundingSphere.center), translation);
+    caster_bounds.radius = caster.BoundingSphere.radius;
+
+    Vector3 offset = Vector3::Subtract(light.position, caster_bounds.center);
+    double distance = Vector3::Length(offset);
+
+    ready = distance > caster_bounds.radius;
+    if (!ready) {
+        return;
+    }
+
+    // Looking from the light at the caster, the map spans its silhouette
+    // with a texel to spare. The view shows y / z up to tan(fov / 2) / 2.
+    double half_angle = std::asin(caster_bounds.radius / distance);
+
+    camera.MoveTo(distance, std::atan2(offset.Y, offset.X), std::asin(offset.Z / distance));
+    camera.PointAt(caster_bounds.center);
+    camera.SetFieldOfView(2.0 * std::atan(2.0 * std::tan(half_angle) * (1.0 + 2.0 / size)));
+
+    transform = camera.ViewTransform(1.0);
+
+    depth.assign(size_t(size) * size, FAR_DEPTH);
+
+    Matrix caster_transform = transform * Matrix::Transformation(rotation, translation);
+
+    projected.resize(caster.vertexCount());
+    for (size_t i = 0; i < projected.size(); i++) {
+        Vector4 clip = caster_transform * Vector4(caster.X[i], caster.Y[i], caster.Z[i], 1.0);
+
+        // marked with a w of 0 if behind the light
+        projected[i] = clip.W > 0.0
+            ? Vector3(size * (clip.X / clip.W + 0.5), size * (-clip.Y / clip.W + 0.5), -1.0 / clip.W)
+            : Vector3(0.0, 0.0, 0.0);
+    }
+
+    // Light in the caster's model space. A closed caster's faces turned
+    // away from it are behind those turned towards it.
+    Vector3 source = rotation.Inverse().Rotate(Vector3::Subtract(light.position, translation));
+
+    auto draw_faces = [&](const auto* indices) {
+        for (size_t i = 0; i < caster.Triangles.size(); i += 3) {
+            size_t ia = indices[i], ib = indices[i + 1], ic = indices[i + 2];
+
+            if (caster.Closed) {
+                Vector3 vertex_a(caster.X[ia], caster.Y[ia], caster.Z[ia]);
+                Vector3 vertex_b(caster.X[ib], caster.Y[ib], caster.Z[ib]);
+                Vector3 vertex_c(caster.X[ic], caster.Y[ic], caster.Z[ic]);
+
+                Vector3 facing = Vector3::Cross(Vector3::Subtract(vertex_b, vertex_a), Vector3::Subtract(vertex_c, vertex_a));
+
+                if (Vector3::Dot(facing, Vector3::Subtract(vertex_a, source)) >= 0.0) {
+                    continue;
+                }
+            }
+
+            const Vector3& a = projected[ia];
+            const Vector3& b = projected[ib];
+            const Vector3& c = projected[ic];
+
+            if (a.Z < 0.0 && b.Z < 0.0 && c.Z < 0.0) {
+                RasterizeTriangle(a, b, c);
+            }
+        }
+    };
+
+    if (caster.Triangles.Long.empty()) {
+        draw_faces(caster.Triangles.Short.data());
+    } else {
+        draw_faces(caster.Triangles.Long.data());
+    }
+}
+
+bool ShadowMap::Ready() const {
+    return ready;
+}
+
+uint64_t ShadowMap::Version() const {
+    return version;
+}
+
+uint32_t ShadowMap::Size() const {
+    return size;
+}
+
+const Matrix& ShadowMap::Transform() const {
+    return transform;
+}
+
+Color ShadowMap::Attenuation(const Vector3& receiver_normal) const {
+    Vector3 direction = Vector3::Normalize(Vector3::Subtract(light.position, caster_bounds.center));
+    double diffuse = std::min(1.0, std::max(0.0, Vector3::Dot(Vector3::Normalize(receiver_normal), direction)));
+
+    auto remaining = [diffuse](double ambient, double diffuse_color) {
+        double lit = ambient + diffuse * diffuse_color;
+        return lit > 0.0 ? std::min(1.0, ambient / lit) : 1.0;
+    };
+
+    return Color(remaining(light.ambient.Blue, light.diffuse.Blue), remaining(light.ambient.Green, light.diffuse.Green),
+        remaining(light.ambient.Red, light.diffuse.Red), 1.0);
+}
+
+float ShadowMap::Lit(double x, double y, double w) const {
+    if (!ready || w <= 0.0) {
+        return 1.0f;
+    }
+
+    // texel centers at whole coordinates
+    double scale = size / w;
+    double u = x * scale + 0.5 * (size - 1);
+    double v = -y * scale + 0.5 * (size - 1);
+
+    if (u <= -1.0 || v <= -1.0 || u >= size || v >= size) {
+        return 1.0f;
+    }
+
+    int u0 = int(std::floor(u)), v0 = int(std::floor(v));
+    float fu = float(u - u0), fv = float(v - v0);
+
+    // Shadowed where farther from the light than the caster's surface over
+    // the texel, by more than the bias. -1/w grows by about bias / w.
+    double point_depth = -1.0 / w - DEPTH_BIAS / w;
+
+    auto lit_at = [&](int tu, int tv) {
+        if (tu < 0 || tv < 0 || tu >= int(size) || tv >= int(size)) {
+            return 1.0f;
+        }
+
+        return point_depth <= depth[size_t(tv) * size + tu] ? 1.0f : 0.0f;
+    };
+
+    float top = lit_at(u0, v0) + fu * (lit_at(u0 + 1, v0) - lit_at(u0, v0));
+    float bottom = lit_at(u0, v0 + 1) + fu * (lit_at(u0 + 1, v0 + 1) - lit_at(u0, v0 + 1));
+
+    return top + fv * (bottom - top);
+}
+
+void ShadowMap::RasterizeTriangle(const Vector3& a, const Vector3& b, const Vector3& c) {
+    double area = (b.X - a.X) * (c.Y - a.Y) - (b.Y - a.Y) * (c.X - a.X);
+
+    if (area == 0.0) {
+        return;
+    }
+
+    int x0 = std::max(0, int(std::ceil(std::min({ a.X, b.X, c.X }) - 0.5)));
+    int x1 = std::min(int(size) - 1, int(std::floor(std::max({ a.X, b.X, c.X }) - 0.5)));
+    int y0 = std::max(0, int(std::ceil(std::min({ a.Y, b.Y, c.Y }) - 0.5)));
+    int y1 = std::min(int(size) - 1, int(std::floor(std::max({ a.Y, b.Y, c.Y }) - 0.5)));
+
+    // Barycentric weights, normalized by the area so faces wound either way
+    // cover the same texels. Each is linear across the map, as is depth.
+    double inverse_area = 1.0 / area;
+    double step_x[3] = { (b.Y - c.Y) * inverse_area, (c.Y - a.Y) * inverse_area, (a.Y - b.Y) * inverse_area };
+    double depth_step = step_x[0] * a.Z + step_x[1] * b.Z + step_x[2] * c.Z;
+
+    auto weight = [inverse_area](const Vector3& p, const Vector3& q, double x, double y) {
+        return ((q.X - p.X) * (y - p.Y) - (q.Y - p.Y) * (x - p.X)) * inverse_area;
+    };
+
+    for (int y = y0; y <= y1; y++) {
+        double px = x0 + 0.5, py = y + 0.5;
+        double weights[3] = { weight(b, c, px, py), weight(c, a, px, py), weight(a, b, px, py) };
+
+        // The row's span is where all three weights are positive
+        double first = x0, last = x1;
+
+        for (int i = 0; i < 3; i++) {
+            if (step_x[i] > 0.0) {
+                first = std::max(first, x0 + std::ceil(-weights[i] / step_x[i]));
+            } else if (step_x[i] < 0.0) {
+                last = std::min(last, x0 + std::floor(weights[i] / -step_x[i]));
+            } else if (weights[i] < 0.0) {
+                last = first - 1.0;
+            }
+        }
+
+        // An empty span may lie anywhere, even beyond what an int holds; a
+        // nonempty one is within [x0, x1]
+        if (first > last) {
+            continue;
+        }
+
+        float* row = depth.data() + size_t(y) * size;
+        float z = float(weights[0] * a.Z + weights[1] * b.Z + weights[2] * c.Z + (first - x0) * depth_step);
+
+        for (int x = int(first); x <= int(last); x++, z += float(depth_step)) {
+            row[x] = std::min(row[x], z);
+        }
+    }
+}
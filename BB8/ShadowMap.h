@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Camera.h"
+#include "Color.h"
+#include "Lighting.h"
+#include "Matrix.h"
+#include "Mesh.h"
+#include "Quaternion.h"
+#include "RenderMesh.h"
+#include "Vector3.h"
+
+// Depth of one mesh as seen from a light, for finding what it shadows. The
+// map is fitted around the mesh, and only redrawn once it or the light moves.
+class ShadowMap {
+public:
+    // size is the map's width and height in texels
+    ShadowMap(uint32_t size = 1024);
+
+    // Draws the caster in its pose, unless the map already shows it so
+    void Update(const Lighting::Light& light, const RenderMesh& caster, const Quaternion& rotation, const Vector3& translation);
+
+    // Whether there's a map to look up, i.e. a caster the light is outside of
+    bool Ready() const;
+
+    // Changes whenever the map is redrawn
+    uint64_t Version() const;
+
+    uint32_t Size() const;
+
+    // Takes world space to the map's clip space, as Camera::ViewTransform does
+    const Matrix& Transform() const;
+
+    // Fraction of a receiver's color left in shadow, per channel: the
+    // light's ambient term against that plus its diffuse term on a receiver
+    // facing normal near the caster
+    Color Attenuation(const Vector3& receiver_normal) const;
+
+    // Fraction of the light reaching the point with map clip coordinates
+    // x, y and w, from 0 in full shadow to 1, filtered over the nearest texels
+    float Lit(double x, double y, double w) const;
+
+private:
+    // Points this far behind the caster's surface, in units of distance
+    // from the light, are shadowed
+    static constexpr double DEPTH_BIAS = 1e-3;
+
+    uint32_t size;
+
+    // -1/w of the nearest surface over each texel, as RenderDevice stores depth
+    std::vector<float> depth;
+
+    Camera camera;
+    Matrix transform = Matrix(0.0);
+
+    Lighting::Light light;
+    Mesh::Sphere caster_bounds;
+
+    // the caster's vertices on the map, with -1/w as depth
+    std::vector<Vector3> projected;
+
+    // what the map was drawn for
+    const RenderMesh* caster = nullptr;
+    Quaternion rotation = Quaternion::Identity();
+    Vector3 translation;
+
+    bool ready = false;
+    uint64_t version = 0;
+
+    void RasterizeTriangle(const Vector3& a, const Vector3& b, const Vector3& c);
+};
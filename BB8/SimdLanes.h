@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// Lane types let one kernel template be compiled for several vector widths.
+// Each translation unit is built with different instruction set flags, so
+// everything here has internal linkage to keep the linker from mixing
+// AVX instantiations into code that must run on any CPU.
+namespace {
+
+// One double per lane, using the standard library for transcendentals
+struct ScalarLanes {
+    using value = double;
+    using mask = bool;
+    static constexpr size_t width = 1;
+
+    static value load(const double* p) { return *p; }
+    static void store(double* p, value v) { *p = v; }
+    static value set(double x) { return x; }
+
+    static value add(value a, value b) { return a + b; }
+    static value sub(value a, value b) { return a - b; }
+    static value mul(value a, value b) { return a * b; }
+    static value div(value a, value b) { return a / b; }
+
+    static void sincos(value x, value& s, value& c) {
+        s = std::sin(x);
+        c = std::cos(x);
+    }
+};
+
+// Shared polynomial sin/cos for vector lanes, accurate to a few ulp on the
+// angles the simulation produces. Cody-Waite reduction to [-pi/4, pi/4]
+// followed by the Cephes minimax polynomials.
+template <typename Lanes>
+void vector_sincos(typename Lanes::value x, typename Lanes::value& s, typename Lanes::value& c) {
+    using L = Lanes;
+
+    const auto two_over_pi = L::set(0.63661977236758134308);
+    const auto pio2_1 = L::set(1.57079625129699707031e+00);
+    const auto pio2_2 = L::set(7.54978941586159635336e-08);
+    const auto pio2_3 = L::set(5.39030285815811905290e-15);
+
+    // nearest quadrant and remainder
+    auto j = L::round(L::mul(x, two_over_pi));
+    auto r = L::sub(x, L::mul(j, pio2_1));
+    r = L::sub(r, L::mul(j, pio2_2));
+    r = L::sub(r, L::mul(j, pio2_3));
+
+    auto z = L::mul(r, r);
+
+    auto ps = L::set(1.58962301576546568060e-10);
+    ps = L::add(L::mul(ps, z), L::set(-2.50507477628578072866e-8));
+    ps = L::add(L::mul(ps, z), L::set(2.75573136213857245213e-6));
+    ps = L::add(L::mul(ps, z), L::set(-1.98412698295895385996e-4));
+    ps = L::add(L::mul(ps, z), L::set(8.33333333332211858878e-3));
+    ps = L::add(L::mul(ps, z), L::set(-1.66666666666666307295e-1));
+    auto sin_r = L::add(r, L::mul(L::mul(r, z), ps));
+
+    auto pc = L::set(-1.13585365213876817300e-11);
+    pc = L::add(L::mul(pc, z), L::set(2.08757008419747316778e-9));
+    pc = L::add(L::mul(pc, z), L::set(-2.75573141792967388112e-7));
+    pc = L::add(L::mul(pc, z), L::set(2.48015872888517045348e-5));
+    pc = L::add(L::mul(pc, z), L::set(-1.38888888888730564116e-3));
+    pc = L::add(L::mul(pc, z), L::set(4.16666666666665929218e-2));
+    auto cos_r = L::add(L::sub(L::set(1.0), L::mul(L::set(0.5), z)), L::mul(L::mul(z, z), pc));
+
+    // quadrant modulo 4
+    auto q = L::sub(j, L::mul(L::set(4.0), L::floor(L::mul(j, L::set(0.25)))));
+    auto odd = L::equal(L::sub(q, L::mul(L::set(2.0), L::floor(L::mul(q, L::set(0.5))))), L::set(1.0));
+    auto upper = L::greater_equal(q, L::set(2.0));
+    auto middle = L::logical_xor(odd, upper);
+
+    // sin: s, c, -s, -c      cos: c, -s, -c, s
+    s = L::negate_if(upper, L::select(odd, cos_r, sin_r));
+    c = L::negate_if(middle, L::select(odd, sin_r, cos_r));
+}
+
+#if defined(__AVX2__)
+// Four doubles per lane group
+struct AVX2Lanes {
+    using value = __m256d;
+    using mask = __m256d;
+    static constexpr size_t width = 4;
+
+    static value load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, value v) { _mm256_storeu_pd(p, v); }
+    static value set(double x) { return _mm256_set1_pd(x); }
+
+    static value add(value a, value b) { return _mm256_add_pd(a, b); }
+    static value sub(value a, value b) { return _mm256_sub_pd(a, b); }
+    static value mul(value a, value b) { return _mm256_mul_pd(a, b); }
+    static value div(value a, value b) { return _mm256_div_pd(a, b); }
+
+    static value round(value x) { return _mm256_round_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static value floor(value x) { return _mm256_floor_pd(x); }
+
+    static mask equal(value a, value b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static mask greater_equal(value a, value b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static mask logical_xor(mask a, mask b) { return _mm256_xor_pd(a, b); }
+    static value select(mask m, value a, value b) { return _mm256_blendv_pd(b, a, m); }
+    static value negate_if(mask m, value x) { return _mm256_xor_pd(x, _mm256_and_pd(m, _mm256_set1_pd(-0.0))); }
+
+    static void sincos(value x, value& s, value& c) { vector_sincos<AVX2Lanes>(x, s, c); }
+};
+#endif
+
+#if defined(__AVX512F__)
+// Eight doubles per lane group
+struct AVX512Lanes {
+    using value = __m512d;
+    using mask = __mmask8;
+    static constexpr size_t width = 8;
+
+    static value load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, value v) { _mm512_storeu_pd(p, v); }
+    static value set(double x) { return _mm512_set1_pd(x); }
+
+    static value add(value a, value b) { return _mm512_add_pd(a, b); }
+    static value sub(value a, value b) { return _mm512_sub_pd(a, b); }
+    static value mul(value a, value b) { return _mm512_mul_pd(a, b); }
+    static value div(value a, value b) { return _mm512_div_pd(a, b); }
+
+    static value round(value x) { return _mm512_roundscale_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static value floor(value x) { return _mm512_roundscale_pd(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+    static mask equal(value a, value b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static mask greater_equal(value a, value b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+    static mask logical_xor(mask a, mask b) { return mask(a ^ b); }
+    static value select(mask m, value a, value b) { return _mm512_mask_blend_pd(m, b, a); }
+    static value negate_if(mask m, value x) { return _mm512_mask_sub_pd(x, m, _mm512_setzero_pd(), x); }
+
+    static void sincos(value x, value& s, value& c) { vector_sincos<AVX512Lanes>(x, s, c); }
+};
+#endif
+
+}
@@ -1,14 +1,28 @@
 #include "Simulation.h"
 
+#include <algorithm>
 #include <cmath>
-#include <sstream>
 
-#include "framework.h"
+#include "Snapshot.h"
 
 constexpr double PI = 3.1415926535;
 constexpr double g = 9.81;
 
+constexpr uint32_t SNAPSHOT_MAGIC = 0x53384242; // "BB8S"
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+// Steps and tolerances that aren't finite and positive would stall or break
+// the integrators
+static bool valid_step(double value) {
+    return std::isfinite(value) && value > 0.0;
+}
+
 Simulation::Simulation(double radius, double sphere_mass, double pendulum_mass, double pendulum_length, double time_step, Vector3 position)
+    : Simulation(radius, sphere_mass, pendulum_mass, pendulum_length, time_step, position,
+        Gearbox(50.0, 1e-2), Gearbox(30.0, 2.0)) {}
+
+Simulation::Simulation(double radius, double sphere_mass, double pendulum_mass, double pendulum_length, double time_step, Vector3 position,
+    Gearbox drive_gearbox, Gearbox tilt_gearbox)
     : radius(radius),
       sphere_mass(sphere_mass),
       pendulum_mass(pendulum_mass),
@@ -16,21 +30,10 @@ Simulation::Simulation(double radius, double sphere_mass, double pendulum_mass,
       time_step(time_step),
       rolling_friction(0.01),
       position(position),
-      drive_assembly(Vex775(), Gearbox(50.0, 1e-2)),
-      drive_coupling(
-      TorqueInterface(
-          [=](double t) { return drive_acceleration(t) + platform_acceleration(t); },
-          [=](double t) { return drive_d_acceleration(t) + platform_d_acceleration(t); }),
-      TorqueInterface(
-              [=](double t) { return drive_assembly.acceleration(t); },
-              [=](double t) { return drive_assembly.inertia(t); })),
-      tilt_assembly(Vex775(), Gearbox(30.0, 2.0)),
-      tilt_coupling(TorqueInterface(
-          [=](double t) { return tilt_acceleration(t) + pendulum_acceleration(t); },
-          [=](double t) { return tilt_d_acceleration(t) + pendulum_d_acceleration(t); }),
-          TorqueInterface(
-              [=](double t) { return tilt_assembly.acceleration(t); },
-              [=](double t) { return tilt_assembly.inertia(t); })),
+      drive_assembly(Vex775(), drive_gearbox),
+      drive_coupling(DriveLoad{ this }, TorqueInterfaceRef<MotorAssembly>(&drive_assembly)),
+      tilt_assembly(Vex775(), tilt_gearbox),
+      tilt_coupling(TiltLoad{ this }, TorqueInterfaceRef<MotorAssembly>(&tilt_assembly)),
       roll(0.0),
       angular_velocity(0.0),
       heading(0.0),
@@ -39,7 +42,16 @@ Simulation::Simulation(double radius, double sphere_mass, double pendulum_mass,
       platform_angle(0.0),
       platform_velocity(0.0),
       pendulum_angle(0.25 * PI),
-      pendulum_velocity(0.0) {
+      pendulum_velocity(0.0),
+      solver_statistics(),
+      step_callback(),
+      integration(IntegrationMethod::ForwardEuler),
+      absolute_tolerance(1e-6),
+      relative_tolerance(1e-6),
+      mechanical_step(time_step),
+      adaptive_step(time_step),
+      adaptive_rates(),
+      adaptive_rates_valid(false) {
     // initial tilt
     Vector3 axis(-1.0, 0.0, 0.0);
 }
@@ -49,23 +61,70 @@ Vector3 Simulation::get_position() const {
 }
 
 Quaternion Simulation::get_rotation() const {
-    Vector3 axis1 = Vector3(0, 0, -1);
-    Quaternion dr1 = Quaternion::EulerAngle(roll, axis1);
-    Vector3 axis2 = Vector3(1, 0, 0);
-    Quaternion dr2 = Quaternion::EulerAngle(tilt, axis2);
-    Vector3 axis3 = Vector3(0, 0, 1);
-    Quaternion dr3 = Quaternion::EulerAngle(heading, axis3);
-
-    return dr3.Multiply(dr2.Multiply(dr1));
+    return compose_rotation(roll, tilt, heading);
 }
 
 double Simulation::get_heading() const {
     return std::fmod(heading, 2 * PI);
 }
 
+double Simulation::get_tilt() const {
+    return tilt;
+}
+
+double Simulation::get_angular_velocity() const {
+    return angular_velocity;
+}
+
+double Simulation::get_time_step() const {
+    return time_step;
+}
+
 Quaternion Simulation::get_platform_rotation() const {
+    return compose_rotation(platform_angle, tilt, heading);
+}
+
+Quaternion Simulation::get_pendulum_rotation() const {
+    return compose_rotation(platform_angle, pendulum_angle + 0.5*PI, heading);
+}
+
+Simulation::Telemetry Simulation::get_telemetry() const {
+    Telemetry telemetry;
+
+    telemetry.position = position;
+    telemetry.roll = roll;
+    telemetry.tilt = tilt;
+    telemetry.heading = heading;
+    telemetry.platform_angle = platform_angle;
+    telemetry.pendulum_angle = pendulum_angle;
+
+    telemetry.drive_torque = drive_coupling.report().torque;
+    telemetry.tilt_torque = tilt_coupling.report().torque;
+
+    telemetry.drive_voltage = drive_voltage();
+    telemetry.tilt_voltage = tilt_voltage();
+
+    telemetry.drive_current = drive_assembly.state().motor.current;
+    telemetry.tilt_current = tilt_assembly.state().motor.current;
+
+    return telemetry;
+}
+
+Quaternion Simulation::Telemetry::rotation() const {
+    return compose_rotation(roll, tilt, heading);
+}
+
+Quaternion Simulation::Telemetry::platform_rotation() const {
+    return compose_rotation(platform_angle, tilt, heading);
+}
+
+Quaternion Simulation::Telemetry::pendulum_rotation() const {
+    return compose_rotation(platform_angle, pendulum_angle + 0.5*PI, heading);
+}
+
+Quaternion Simulation::compose_rotation(double spin, double tilt, double heading) {
     Vector3 axis1 = Vector3(0, 0, -1);
-    Quaternion dr1 = Quaternion::EulerAngle(platform_angle, axis1);
+    Quaternion dr1 = Quaternion::EulerAngle(spin, axis1);
     Vector3 axis2 = Vector3(1, 0, 0);
     Quaternion dr2 = Quaternion::EulerAngle(tilt, axis2);
     Vector3 axis3 = Vector3(0, 0, 1);
@@ -74,15 +133,24 @@ Quaternion Simulation::get_platform_rotation() const {
     return dr3.Multiply(dr2.Multiply(dr1));
 }
 
-Quaternion Simulation::get_pendulum_rotation() const {
-    Vector3 axis1 = Vector3(0, 0, -1);
-    Quaternion dr1 = Quaternion::EulerAngle(platform_angle, axis1);
-    Vector3 axis2 = Vector3(1, 0, 0);
-    Quaternion dr2 = Quaternion::EulerAngle(pendulum_angle + 0.5*PI, axis2);
-    Vector3 axis3 = Vector3(0, 0, 1);
-    Quaternion dr3 = Quaternion::EulerAngle(heading, axis3);
+Simulation::SolverStatistics Simulation::get_solver_statistics() const {
+    return solver_statistics;
+}
 
-    return dr3.Multiply(dr2.Multiply(dr1));
+double Simulation::DriveLoad::acceleration(double torque) const {
+    return simulation->drive_acceleration(torque) + simulation->platform_acceleration(torque);
+}
+
+double Simulation::DriveLoad::inertia(double torque) const {
+    return simulation->drive_d_acceleration(torque) + simulation->platform_d_acceleration(torque);
+}
+
+double Simulation::TiltLoad::acceleration(double torque) const {
+    return simulation->tilt_acceleration(torque) + simulation->pendulum_acceleration(torque);
+}
+
+double Simulation::TiltLoad::inertia(double torque) const {
+    return simulation->tilt_d_acceleration(torque) + simulation->pendulum_d_acceleration(torque);
 }
 
 double Simulation::drive_acceleration(double torque) const {
@@ -133,23 +201,338 @@ double Simulation::pendulum_d_acceleration(double torque) const {
 }
 
 void Simulation::update(double elapsed_time) {
-    while (elapsed_time > time_step) {
-        elapsed_time -= time_step;
-        fixed_update(time_step);
+    if (integration == IntegrationMethod::DormandPrince) {
+        adaptive_update(elapsed_time);
+        return;
+    }
+
+    double step = integration == IntegrationMethod::MultiRate ? mechanical_step : time_step;
+
+    while (elapsed_time > step) {
+        elapsed_time -= step;
+        fixed_update(step);
+
+        if (step_callback) {
+            step_callback(*this, step);
+        }
     }
 
     fixed_update(elapsed_time);
+
+    if (step_callback) {
+        step_callback(*this, elapsed_time);
+    }
+}
+
+void Simulation::set_step_callback(StepCallback callback) {
+    step_callback = std::move(callback);
+}
+
+void Simulation::set_integration(IntegrationMethod method, double absolute_tolerance, double relative_tolerance) {
+    integration = method;
+    this->absolute_tolerance = absolute_tolerance;
+    this->relative_tolerance = relative_tolerance;
+
+    adaptive_step = time_step;
+    adaptive_rates_valid = false;
+}
+
+IntegrationMethod Simulation::get_integration() const {
+    return integration;
+}
+
+bool Simulation::set_mechanical_step(double mechanical_step) {
+    if (!valid_step(mechanical_step)) {
+        return false;
+    }
+
+    this->mechanical_step = mechanical_step;
+    return true;
+}
+
+double Simulation::get_mechanical_step() const {
+    return mechanical_step;
+}
+
+std::vector<uint8_t> Simulation::save_snapshot() const {
+    std::vector<uint8_t> snapshot;
+    SnapshotWriter writer(snapshot);
+
+    writer.write(SNAPSHOT_MAGIC);
+    writer.write(SNAPSHOT_VERSION);
+
+    writer.write(radius);
+    writer.write(sphere_mass);
+    writer.write(pendulum_mass);
+    writer.write(pendulum_length);
+    writer.write(time_step);
+    writer.write(drive_assembly.parameters());
+    writer.write(tilt_assembly.parameters());
+
+    // the state vector omits height and the gearboxes
+    writer.write(get_state_vector());
+    writer.write(position.Z);
+    writer.write(drive_assembly.state().gearbox_velocity);
+    writer.write(tilt_assembly.state().gearbox_velocity);
+
+    writer.write(drive_coupling.last_torque());
+    writer.write(tilt_coupling.last_torque());
+
+    writer.write(static_cast<uint32_t>(integration));
+    writer.write(absolute_tolerance);
+    writer.write(relative_tolerance);
+    writer.write(mechanical_step);
+    writer.write(adaptive_step);
+    writer.write(static_cast<uint32_t>(adaptive_rates_valid));
+    writer.write(adaptive_rates);
+
+    // field by field, at fixed widths whatever size_t is
+    writer.write(static_cast<uint64_t>(solver_statistics.solves));
+    writer.write(static_cast<uint64_t>(solver_statistics.iterations));
+    writer.write(static_cast<uint64_t>(solver_statistics.failures));
+    writer.write(solver_statistics.max_residual);
+
+    return snapshot;
+}
+
+bool Simulation::load_snapshot(const std::vector<uint8_t>& snapshot) {
+    SnapshotReader reader(snapshot.data(), snapshot.size());
+
+    uint32_t magic = 0, version = 0;
+    reader.read(magic);
+    reader.read(version);
+
+    if (!reader.ok() || magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+        return false;
+    }
+
+    double parameters[5] = {};
+    for (double& parameter : parameters) {
+        reader.read(parameter);
+    }
+
+    std::array<double, 8> drive_parameters = {}, tilt_parameters = {};
+    reader.read(drive_parameters);
+    reader.read(tilt_parameters);
+
+    if (parameters[0] != radius || parameters[1] != sphere_mass
+        || parameters[2] != pendulum_mass || parameters[3] != pendulum_length || parameters[4] != time_step
+        || drive_parameters != drive_assembly.parameters() || tilt_parameters != tilt_assembly.parameters()) {
+        return false;
+    }
+
+    StateVector state;
+    double z, drive_gearbox_velocity, tilt_gearbox_velocity;
+    double drive_torque, tilt_torque;
+    uint32_t method;
+    double absolute, relative, mechanical, adaptive;
+    uint32_t rates_valid;
+    StateVector rates;
+    uint64_t solves, iterations, failures;
+    double max_residual;
+
+    reader.read(state);
+    reader.read(z);
+    reader.read(drive_gearbox_velocity);
+    reader.read(tilt_gearbox_velocity);
+    reader.read(drive_torque);
+    reader.read(tilt_torque);
+    reader.read(method);
+    reader.read(absolute);
+    reader.read(relative);
+    reader.read(mechanical);
+    reader.read(adaptive);
+    reader.read(rates_valid);
+    reader.read(rates);
+    reader.read(solves);
+    reader.read(iterations);
+    reader.read(failures);
+    reader.read(max_residual);
+
+    if (!reader.ok() || !reader.at_end() || method > static_cast<uint32_t>(IntegrationMethod::MultiRate)) {
+        return false;
+    }
+
+    if (!valid_step(absolute) || !valid_step(relative) || !valid_step(mechanical) || !valid_step(adaptive)) {
+        return false;
+    }
+
+    set_state_vector(state);
+    position.Z = z;
+    drive_assembly.set_state({ { state[DRIVE_MOTOR_VELOCITY], state[DRIVE_CURRENT] }, drive_gearbox_velocity });
+    tilt_assembly.set_state({ { state[TILT_MOTOR_VELOCITY], state[TILT_CURRENT] }, tilt_gearbox_velocity });
+
+    drive_coupling.set_last_torque(drive_torque);
+    tilt_coupling.set_last_torque(tilt_torque);
+
+    integration = static_cast<IntegrationMethod>(method);
+    absolute_tolerance = absolute;
+    relative_tolerance = relative;
+    mechanical_step = mechanical;
+    adaptive_step = adaptive;
+    // recomputing these would start the coupling solves from other torques
+    adaptive_rates_valid = rates_valid != 0;
+    adaptive_rates = rates;
+
+    solver_statistics.solves = size_t(solves);
+    solver_statistics.iterations = size_t(iterations);
+    solver_statistics.failures = size_t(failures);
+    solver_statistics.max_residual = max_residual;
+
+    return true;
+}
+
+double Simulation::drive_voltage() const {
+    return 1 * PI - angular_velocity;
+}
+
+double Simulation::tilt_voltage() const {
+    return 5 * (0.4 * PI - tilt) - 10 * tilt_velocity;
+}
+
+Simulation::StateVector Simulation::get_state_vector() const {
+    auto drive = drive_assembly.state();
+    auto tilt_motor = tilt_assembly.state();
+
+    return {
+        position.X, position.Y, heading, roll, tilt, platform_angle, pendulum_angle,
+        angular_velocity, tilt_velocity, platform_velocity, pendulum_velocity,
+        drive.motor.angular_velocity, drive.motor.current, tilt_motor.motor.angular_velocity, tilt_motor.motor.current
+    };
+}
+
+void Simulation::set_state_vector(const StateVector& state) {
+    position = Vector3(state[X], state[Y], position.Z);
+    heading = state[HEADING];
+    roll = state[ROLL];
+    tilt = state[TILT];
+    platform_angle = state[PLATFORM_ANGLE];
+    pendulum_angle = state[PENDULUM_ANGLE];
+    angular_velocity = state[ANGULAR_VELOCITY];
+    tilt_velocity = state[TILT_VELOCITY];
+    platform_velocity = state[PLATFORM_VELOCITY];
+    pendulum_velocity = state[PENDULUM_VELOCITY];
+
+    // gearboxes always turn with their motors
+    drive_assembly.set_state({ { state[DRIVE_MOTOR_VELOCITY], state[DRIVE_CURRENT] }, state[DRIVE_MOTOR_VELOCITY] });
+    tilt_assembly.set_state({ { state[TILT_MOTOR_VELOCITY], state[TILT_CURRENT] }, state[TILT_MOTOR_VELOCITY] });
+}
+
+void Simulation::derivative(const StateVector& state, StateVector& rates) {
+    set_state_vector(state);
+
+    auto [torque_m, drive_shaft_acceleration] = drive_coupling.solve();
+    auto [torque_p, tilt_shaft_acceleration] = tilt_coupling.solve();
+
+    record_solve(drive_coupling.report());
+    record_solve(tilt_coupling.report());
+
+    kinematics(state, rates);
+
+    rates[ANGULAR_VELOCITY] = drive_acceleration(torque_m);
+    rates[TILT_VELOCITY] = tilt_acceleration(torque_p);
+    rates[PLATFORM_VELOCITY] = platform_acceleration(torque_m);
+    rates[PENDULUM_VELOCITY] = pendulum_acceleration(torque_p);
+
+    auto drive = drive_assembly.derivative(drive_voltage(), torque_m);
+    auto tilt_motor = tilt_assembly.derivative(tilt_voltage(), torque_p);
+    rates[DRIVE_MOTOR_VELOCITY] = drive.angular_velocity;
+    rates[DRIVE_CURRENT] = drive.current;
+    rates[TILT_MOTOR_VELOCITY] = tilt_motor.angular_velocity;
+    rates[TILT_CURRENT] = tilt_motor.current;
+}
+
+void Simulation::kinematics(const StateVector& state, StateVector& rates) const {
+    double ground_speed = state[ANGULAR_VELOCITY] * std::sin(state[TILT]) * radius;
+    rates[X] = ground_speed * std::cos(state[HEADING]);
+    rates[Y] = ground_speed * std::sin(state[HEADING]);
+    rates[HEADING] = state[ANGULAR_VELOCITY] * std::cos(state[TILT]);
+    rates[ROLL] = state[ANGULAR_VELOCITY];
+    rates[TILT] = state[TILT_VELOCITY];
+    rates[PLATFORM_ANGLE] = state[PLATFORM_VELOCITY];
+    rates[PENDULUM_ANGLE] = state[PENDULUM_VELOCITY];
 }
 
 void Simulation::fixed_update(double dt) {
-    double ground_speed = angular_velocity * std::sin(tilt) * radius;
-    double dx = dt * ground_speed * std::cos(heading);
-    double dy = dt * ground_speed * std::sin(heading);
+    if (integration == IntegrationMethod::ForwardEuler) {
+        euler_update(dt);
+        return;
+    }
 
-    position = Vector3::Add(position, Vector3(dx, dy, 0.0));
+    if (integration == IntegrationMethod::MultiRate) {
+        multi_rate_update(dt);
+        return;
+    }
 
-    double dtheta = dt * angular_velocity * std::cos(tilt);
-    heading += dtheta;
+    auto f = [this](const StateVector& state, StateVector& rates) { derivative(state, rates); };
+    StateVector state = get_state_vector();
+
+    if (integration == IntegrationMethod::SemiImplicitEuler) {
+        static const std::array<bool, STATE_SIZE> is_rate = {
+            false, false, false, false, false, false, false,
+            true, true, true, true, true, true, true, true
+        };
+
+        auto g = [this](const StateVector& state, StateVector& rates) { kinematics(state, rates); };
+        Integrator<STATE_SIZE>::SemiImplicitEuler(state, dt, f, g, is_rate);
+    } else {
+        Integrator<STATE_SIZE>::RK4(state, dt, f);
+    }
+
+    set_state_vector(state);
+}
+
+void Simulation::adaptive_update(double elapsed_time) {
+    auto f = [this](const StateVector& state, StateVector& rates) { derivative(state, rates); };
+    StateVector state = get_state_vector();
+
+    if (!adaptive_rates_valid) {
+        derivative(state, adaptive_rates);
+        adaptive_rates_valid = true;
+    }
+
+    // below this the remaining time is rounding error
+    double min_step = 1e-12 * time_step;
+
+    while (elapsed_time > min_step) {
+        double dt = std::min(adaptive_step, elapsed_time);
+        double error = Integrator<STATE_SIZE>::DormandPrince(state, adaptive_rates, dt, f, absolute_tolerance, relative_tolerance);
+
+        if (error <= 1.0) {
+            elapsed_time -= dt;
+
+            if (step_callback) {
+                set_state_vector(state);
+                step_callback(*this, dt);
+            }
+        } else if (dt <= min_step) {
+            // Shrinking the step no further helps, or the error isn't even
+            // finite: leave the rest of the interval and count it as failed
+            solver_statistics.failures++;
+            break;
+        }
+
+        // a step clipped to the end of the interval doesn't say anything about growing
+        if (error > 1.0 || dt == adaptive_step) {
+            adaptive_step = std::min(time_step, std::max(min_step, Integrator<STATE_SIZE>::NextStepSize(dt, error)));
+        }
+    }
+
+    set_state_vector(state);
+}
+
+void Simulation::record_solve(const SolverReport& report) {
+    solver_statistics.solves++;
+    solver_statistics.iterations += report.iterations;
+    solver_statistics.max_residual = std::max(solver_statistics.max_residual, report.residual);
+
+    if (!report.converged) {
+        solver_statistics.failures++;
+    }
+}
+
+void Simulation::euler_update(double dt) {
+    advance_position(dt);
 
     constexpr double tilt_setpoint = 0.4 * PI;
 
@@ -157,12 +540,47 @@ void Simulation::fixed_update(double dt) {
     auto [torque_m, drive_shaft_acceleration] = drive_coupling.solve();
     auto [torque_p, tilt_shaft_acceleration] = tilt_coupling.solve();
 
-    double drive_voltage = 1 * PI - angular_velocity;
-    drive_assembly.update(drive_voltage, torque_m, dt);
+    record_solve(drive_coupling.report());
+    record_solve(tilt_coupling.report());
+
+    drive_assembly.update(drive_voltage(), torque_m, dt);
+    tilt_assembly.update(tilt_voltage(), torque_p, dt);
+
+    advance_mechanics(dt, torque_m, torque_p);
+}
 
-    double tilt_voltage = 5 * (0.4 * PI - tilt) - 10 * tilt_velocity;
-    tilt_assembly.update(tilt_voltage, torque_p, dt);
+void Simulation::multi_rate_update(double dt) {
+    advance_position(dt);
+
+    // voltages are held over the step, so current settles exactly
+    drive_assembly.update_current(drive_voltage(), dt);
+    tilt_assembly.update_current(tilt_voltage(), dt);
+
+    // negotiate torque against the end of step current
+    auto [torque_m, drive_shaft_acceleration] = drive_coupling.solve();
+    auto [torque_p, tilt_shaft_acceleration] = tilt_coupling.solve();
+
+    record_solve(drive_coupling.report());
+    record_solve(tilt_coupling.report());
+
+    drive_assembly.update_velocity(torque_m, dt);
+    tilt_assembly.update_velocity(torque_p, dt);
+
+    advance_mechanics(dt, torque_m, torque_p);
+}
+
+void Simulation::advance_position(double dt) {
+    double ground_speed = angular_velocity * std::sin(tilt) * radius;
+    double dx = dt * ground_speed * std::cos(heading);
+    double dy = dt * ground_speed * std::sin(heading);
+
+    position = Vector3::Add(position, Vector3(dx, dy, 0.0));
+
+    double dtheta = dt * angular_velocity * std::cos(tilt);
+    heading += dtheta;
+}
 
+void Simulation::advance_mechanics(double dt, double torque_m, double torque_p) {
     angular_velocity += dt * drive_acceleration(torque_m);
     roll += dt * angular_velocity;
 
@@ -1,29 +1,148 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <tuple>
+#include <vector>
 
 #include "Gearbox.h"
+#include "Integrator.h"
 #include "Motor.h"
 #include "MotorAssembly.h"
 #include "Quaternion.h"
-#include "TorqueCoupling.h"
+#include "StaticTorqueCoupling.h"
 #include "Vector3.h"
 
 class Simulation
 {
 public:
+    class SolverStatistics {
+    public:
+        size_t solves;
+        size_t iterations;
+        // solves that didn't converge, and adaptive intervals abandoned
+        // at the smallest step
+        size_t failures;
+        double max_residual;
+    };
+
+    // Raw per-step state for logging. Rotations are composed on demand, so
+    // a logger can leave that work to another thread.
+    class Telemetry {
+    public:
+        Vector3 position;
+        double roll;
+        double tilt;
+        double heading;
+        double platform_angle;
+        double pendulum_angle;
+
+        // same as the simulation's get_rotation and friends
+        Quaternion rotation() const;
+        Quaternion platform_rotation() const;
+        Quaternion pendulum_rotation() const;
+
+        // from the most recent coupling solves
+        double drive_torque;
+        double tilt_torque;
+
+        // applied by the controllers at the current state
+        double drive_voltage;
+        double tilt_voltage;
+
+        double drive_current;
+        double tilt_current;
+    };
+
+    using StepCallback = std::function<void(const Simulation& simulation, double dt)>;
+
     Simulation(double radius, double sphere_mass, double pendulum_mass, double pendulum_length, double time_step, Vector3 position);
+    Simulation(double radius, double sphere_mass, double pendulum_mass, double pendulum_length, double time_step, Vector3 position,
+        Gearbox drive_gearbox, Gearbox tilt_gearbox);
+
+    // couplings capture this simulation, so it can't be copied or moved
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
 
     Vector3 get_position() const;
     Quaternion get_rotation() const;
     double get_heading() const;
+    double get_tilt() const;
+    double get_angular_velocity() const;
+    double get_time_step() const;
 
     Quaternion get_platform_rotation() const;
     Quaternion get_pendulum_rotation() const;
 
+    Telemetry get_telemetry() const;
+
+    // accumulated over both couplings since construction
+    SolverStatistics get_solver_statistics() const;
+
     void update(double elapsed_time);
 
+    // Called after every step update takes, with the step size. Keep it
+    // cheap, it runs on the simulation thread at the full step rate.
+    void set_step_callback(StepCallback callback);
+
+    // ForwardEuler, the default, keeps the original update order. The adaptive
+    // DormandPrince method treats time_step as its initial and maximum step,
+    // and sizes steps to keep error within the given tolerances.
+    void set_integration(IntegrationMethod method, double absolute_tolerance = 1e-6, double relative_tolerance = 1e-6);
+    IntegrationMethod get_integration() const;
+
+    // MultiRate steps the mechanics, and solves the couplings, once per
+    // mechanical step. Motor current is far stiffer, so it is integrated
+    // exactly across each step instead. Defaults to time_step. A step that
+    // isn't finite and positive is rejected, returning false.
+    bool set_mechanical_step(double mechanical_step);
+    double get_mechanical_step() const;
+
+    // Versioned binary checkpoint of the complete dynamic state: coordinates,
+    // rates, motors, gearboxes, coupling warm starts, integration settings and
+    // solver statistics. Stepping a restored simulation reproduces the
+    // original exactly. load_snapshot rejects snapshots of a different
+    // format, of a simulation with other physical parameters, time step or
+    // drives, or with steps or tolerances that aren't finite and positive,
+    // returning false and leaving this simulation untouched.
+    std::vector<uint8_t> save_snapshot() const;
+    bool load_snapshot(const std::vector<uint8_t>& snapshot);
+
 private:
+    // Load seen by the drive assembly: sphere roll plus platform swing
+    class DriveLoad {
+    public:
+        const Simulation* simulation;
+
+        double acceleration(double torque) const;
+        double inertia(double torque) const;
+        bool affine() const { return true; }
+    };
+
+    // Load seen by the tilt assembly: sphere tilt plus pendulum swing
+    class TiltLoad {
+    public:
+        const Simulation* simulation;
+
+        double acceleration(double torque) const;
+        double inertia(double torque) const;
+        bool affine() const { return true; }
+    };
+
+    // coordinates first, then rates, see is_rate
+    enum StateIndex {
+        X, Y, HEADING, ROLL, TILT, PLATFORM_ANGLE, PENDULUM_ANGLE,
+        ANGULAR_VELOCITY, TILT_VELOCITY, PLATFORM_VELOCITY, PENDULUM_VELOCITY,
+        DRIVE_MOTOR_VELOCITY, DRIVE_CURRENT, TILT_MOTOR_VELOCITY, TILT_CURRENT,
+        STATE_SIZE
+    };
+
+    using StateVector = Integrator<STATE_SIZE>::State;
+
+    using DriveCoupling = StaticTorqueCoupling<DriveLoad, TorqueInterfaceRef<MotorAssembly>>;
+    using TiltCoupling = StaticTorqueCoupling<TiltLoad, TorqueInterfaceRef<MotorAssembly>>;
+
     const double radius;
     const double sphere_mass;
     const double pendulum_mass;
@@ -35,10 +154,10 @@ private:
     Vector3 position;
 
     MotorAssembly drive_assembly;
-    TorqueCoupling drive_coupling;
+    DriveCoupling drive_coupling;
 
     MotorAssembly tilt_assembly;
-    TorqueCoupling tilt_coupling;
+    TiltCoupling tilt_coupling;
 
     double roll;
     double angular_velocity;
@@ -50,6 +169,19 @@ private:
     double pendulum_angle;
     double pendulum_velocity;
 
+    SolverStatistics solver_statistics;
+    StepCallback step_callback;
+
+    IntegrationMethod integration;
+    double absolute_tolerance;
+    double relative_tolerance;
+    double mechanical_step;
+
+    // adaptive integration state
+    double adaptive_step;
+    StateVector adaptive_rates;
+    bool adaptive_rates_valid;
+
     double drive_acceleration(double drive_torque) const;
     double drive_d_acceleration(double drive_torque) const;
 
@@ -62,5 +194,27 @@ private:
     double pendulum_acceleration(double tilt_torque) const;
     double pendulum_d_acceleration(double tilt_torque) const;
 
+    void record_solve(const SolverReport& report);
+
+    // heading about z, then tilt about x, then spin about -z
+    static Quaternion compose_rotation(double spin, double tilt, double heading);
+
+    double drive_voltage() const;
+    double tilt_voltage() const;
+
+    StateVector get_state_vector() const;
+    void set_state_vector(const StateVector& state);
+    // time derivative of state, solving both couplings at that state
+    void derivative(const StateVector& state, StateVector& rates);
+    // just the coordinates' rates, which follow from the state without a solve
+    void kinematics(const StateVector& state, StateVector& rates) const;
+
     void fixed_update(double dt);
+    void euler_update(double dt);
+    void multi_rate_update(double dt);
+
+    // shared by the sequential updates
+    void advance_position(double dt);
+    void advance_mechanics(double dt, double torque_m, double torque_p);
+    void adaptive_update(double elapsed_time);
 };
@@ -0,0 +1,161 @@
+#include "SimulationBatch.h"
+
+#include <cmath>
+
+#include "CpuFeatures.h"
+#include "SimulationBatchKernel.h"
+
+constexpr double PI = 3.1415926535;
+
+SimulationBatch::SimulationBatch(double time_step, Motor drive_motor, Motor tilt_motor)
+    : time_step(time_step), drive_motor(drive_motor), tilt_motor(tilt_motor), active_kernel(Kernel::Scalar) {
+    set_kernel(Kernel::AVX512);
+}
+
+size_t SimulationBatch::add(double radius, double sphere_mass, double pendulum_mass, double pendulum_length, Vector3 position,
+    Gearbox drive_gearbox, Gearbox tilt_gearbox) {
+    // initial conditions match Simulation
+    x.push_back(position.X);
+    y.push_back(position.Y);
+    heading.push_back(0.0);
+    roll.push_back(0.0);
+    angular_velocity.push_back(0.0);
+    tilt.push_back(0.43 * PI);
+    tilt_velocity.push_back(0.0);
+    platform_angle.push_back(0.0);
+    platform_velocity.push_back(0.0);
+    pendulum_angle.push_back(0.25 * PI);
+    pendulum_velocity.push_back(0.0);
+    drive_motor_velocity.push_back(0.0);
+    drive_current.push_back(0.0);
+    tilt_motor_velocity.push_back(0.0);
+    tilt_current.push_back(0.0);
+
+    this->radius.push_back(radius);
+    this->sphere_mass.push_back(sphere_mass);
+    this->pendulum_mass.push_back(pendulum_mass);
+    this->pendulum_length.push_back(pendulum_length);
+    drive_ratio.push_back(drive_gearbox.ratio);
+    drive_damping.push_back(drive_gearbox.damping);
+    tilt_ratio.push_back(tilt_gearbox.ratio);
+    tilt_damping.push_back(tilt_gearbox.damping);
+
+    return x.size() - 1;
+}
+
+size_t SimulationBatch::size() const {
+    return x.size();
+}
+
+Vector3 SimulationBatch::get_position(size_t index) const {
+    return Vector3(x[index], y[index], radius[index]);
+}
+
+Quaternion SimulationBatch::get_rotation(size_t index) const {
+    Quaternion dr1 = Quaternion::EulerAngle(roll[index], Vector3(0, 0, -1));
+    Quaternion dr2 = Quaternion::EulerAngle(tilt[index], Vector3(1, 0, 0));
+    Quaternion dr3 = Quaternion::EulerAngle(heading[index], Vector3(0, 0, 1));
+
+    return dr3.Multiply(dr2.Multiply(dr1));
+}
+
+double SimulationBatch::get_heading(size_t index) const {
+    return std::fmod(heading[index], 2 * PI);
+}
+
+double SimulationBatch::get_tilt(size_t index) const {
+    return tilt[index];
+}
+
+double SimulationBatch::get_angular_velocity(size_t index) const {
+    return angular_velocity[index];
+}
+
+Quaternion SimulationBatch::get_platform_rotation(size_t index) const {
+    Quaternion dr1 = Quaternion::EulerAngle(platform_angle[index], Vector3(0, 0, -1));
+    Quaternion dr2 = Quaternion::EulerAngle(tilt[index], Vector3(1, 0, 0));
+    Quaternion dr3 = Quaternion::EulerAngle(heading[index], Vector3(0, 0, 1));
+
+    return dr3.Multiply(dr2.Multiply(dr1));
+}
+
+Quaternion SimulationBatch::get_pendulum_rotation(size_t index) const {
+    Quaternion dr1 = Quaternion::EulerAngle(platform_angle[index], Vector3(0, 0, -1));
+    Quaternion dr2 = Quaternion::EulerAngle(pendulum_angle[index] + 0.5 * PI, Vector3(1, 0, 0));
+    Quaternion dr3 = Quaternion::EulerAngle(heading[index], Vector3(0, 0, 1));
+
+    return dr3.Multiply(dr2.Multiply(dr1));
+}
+
+SimulationBatch::Kernel SimulationBatch::kernel() const {
+    return active_kernel;
+}
+
+void SimulationBatch::set_kernel(Kernel kernel) {
+    if (kernel == Kernel::AVX512 && !(BatchKernelAVX512() && CpuFeatures::AVX512())) {
+        kernel = Kernel::AVX2;
+    }
+
+    if (kernel == Kernel::AVX2 && !(BatchKernelAVX2() && CpuFeatures::AVX2())) {
+        kernel = Kernel::Scalar;
+    }
+
+    active_kernel = kernel;
+}
+
+void SimulationBatch::update(double elapsed_time) {
+    while (elapsed_time > time_step) {
+        elapsed_time -= time_step;
+        fixed_update(time_step);
+    }
+
+    fixed_update(elapsed_time);
+}
+
+BatchColumns SimulationBatch::columns() {
+    BatchColumns columns;
+
+    columns.x = x.data();
+    columns.y = y.data();
+    columns.heading = heading.data();
+    columns.roll = roll.data();
+    columns.angular_velocity = angular_velocity.data();
+    columns.tilt = tilt.data();
+    columns.tilt_velocity = tilt_velocity.data();
+    columns.platform_angle = platform_angle.data();
+    columns.platform_velocity = platform_velocity.data();
+    columns.pendulum_angle = pendulum_angle.data();
+    columns.pendulum_velocity = pendulum_velocity.data();
+    columns.drive_motor_velocity = drive_motor_velocity.data();
+    columns.drive_current = drive_current.data();
+    columns.tilt_motor_velocity = tilt_motor_velocity.data();
+    columns.tilt_current = tilt_current.data();
+
+    columns.radius = radius.data();
+    columns.sphere_mass = sphere_mass.data();
+    columns.pendulum_mass = pendulum_mass.data();
+    columns.pendulum_length = pendulum_length.data();
+    columns.drive_ratio = drive_ratio.data();
+    columns.drive_damping = drive_damping.data();
+    columns.tilt_ratio = tilt_ratio.data();
+    columns.tilt_damping = tilt_damping.data();
+
+    columns.drive_motor = { drive_motor.Kt, drive_motor.Kv, drive_motor.damping,
+        drive_motor.inertia, drive_motor.resistance, drive_motor.inductance };
+    columns.tilt_motor = { tilt_motor.Kt, tilt_motor.Kv, tilt_motor.damping,
+        tilt_motor.inertia, tilt_motor.resistance, tilt_motor.inductance };
+
+    return columns;
+}
+
+void SimulationBatch::fixed_update(double dt) {
+    BatchKernel step = &step_batch<ScalarLanes>;
+
+    if (active_kernel == Kernel::AVX512) {
+        step = BatchKernelAVX512();
+    } else if (active_kernel == Kernel::AVX2) {
+        step = BatchKernelAVX2();
+    }
+
+    step(columns(), 0, size(), dt);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Gearbox.h"
+#include "Motor.h"
+#include "Quaternion.h"
+#include "Vector3.h"
+
+class BatchColumns;
+
+// Advances many robots in lockstep with the same dynamics as Simulation.
+// State is stored as one contiguous column per variable so the step kernel
+// can process several robots per vector instruction.
+class SimulationBatch
+{
+public:
+    enum class Kernel { Scalar, AVX2, AVX512 };
+
+    SimulationBatch(double time_step, Motor drive_motor = Vex775(), Motor tilt_motor = Vex775());
+
+    // returns index of the new robot
+    size_t add(double radius, double sphere_mass, double pendulum_mass, double pendulum_length, Vector3 position,
+        Gearbox drive_gearbox, Gearbox tilt_gearbox);
+
+    size_t size() const;
+
+    Vector3 get_position(size_t index) const;
+    Quaternion get_rotation(size_t index) const;
+    double get_heading(size_t index) const;
+    double get_tilt(size_t index) const;
+    double get_angular_velocity(size_t index) const;
+
+    Quaternion get_platform_rotation(size_t index) const;
+    Quaternion get_pendulum_rotation(size_t index) const;
+
+    // the kernel in use: the widest the build and CPU support, unless
+    // set_kernel picked a narrower one
+    Kernel kernel() const;
+    // falls back to the widest available kernel if unsupported
+    void set_kernel(Kernel kernel);
+
+    void update(double elapsed_time);
+
+private:
+    const double time_step;
+
+    const Motor drive_motor;
+    const Motor tilt_motor;
+
+    Kernel active_kernel;
+
+    std::vector<double> x, y;
+    std::vector<double> heading;
+    std::vector<double> roll;
+    std::vector<double> angular_velocity;
+    std::vector<double> tilt;
+    std::vector<double> tilt_velocity;
+    std::vector<double> platform_angle;
+    std::vector<double> platform_velocity;
+    std::vector<double> pendulum_angle;
+    std::vector<double> pendulum_velocity;
+    std::vector<double> drive_motor_velocity;
+    std::vector<double> drive_current;
+    std::vector<double> tilt_motor_velocity;
+    std::vector<double> tilt_current;
+
+    std::vector<double> radius;
+    std::vector<double> sphere_mass;
+    std::vector<double> pendulum_mass;
+    std::vector<double> pendulum_length;
+    std::vector<double> drive_ratio;
+    std::vector<double> drive_damping;
+    std::vector<double> tilt_ratio;
+    std::vector<double> tilt_damping;
+
+    BatchColumns columns();
+
+    void fixed_update(double dt);
+};
@@ -0,0 +1,13 @@
+#include "SimulationBatchKernel.h"
+
+// Built with /arch:AVX2 (or -mavx2), and only called after CpuFeatures::AVX2()
+
+#if defined(__AVX2__)
+BatchKernel BatchKernelAVX2() {
+    return &step_batch<AVX2Lanes>;
+}
+#else
+BatchKernel BatchKernelAVX2() {
+    return nullptr;
+}
+#endif
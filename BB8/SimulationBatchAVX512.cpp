@@ -0,0 +1,13 @@
+#include "SimulationBatchKernel.h"
+
+// Built with /arch:AVX512 (or -mavx512f), and only called after CpuFeatures::AVX512()
+
+#if defined(__AVX512F__)
+BatchKernel BatchKernelAVX512() {
+    return &step_batch<AVX512Lanes>;
+}
+#else
+BatchKernel BatchKernelAVX512() {
+    return nullptr;
+}
+#endif
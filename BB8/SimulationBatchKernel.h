@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+
+#include "SimdLanes.h"
+
+// Column pointers for a SimulationBatch. State columns are read and written,
+// parameter columns are read only. All columns hold one entry per robot.
+class BatchColumns {
+public:
+    class MotorConstants {
+    public:
+        double Kt, Kv, damping, inertia, resistance, inductance;
+    };
+
+    double* x;
+    double* y;
+    double* heading;
+    double* roll;
+    double* angular_velocity;
+    double* tilt;
+    double* tilt_velocity;
+    double* platform_angle;
+    double* platform_velocity;
+    double* pendulum_angle;
+    double* pendulum_velocity;
+    double* drive_motor_velocity;
+    double* drive_current;
+    double* tilt_motor_velocity;
+    double* tilt_current;
+
+    const double* radius;
+    const double* sphere_mass;
+    const double* pendulum_mass;
+    const double* pendulum_length;
+    const double* drive_ratio;
+    const double* drive_damping;
+    const double* tilt_ratio;
+    const double* tilt_damping;
+
+    MotorConstants drive_motor;
+    MotorConstants tilt_motor;
+};
+
+// Advances robots [begin, end) by dt
+using BatchKernel = void (*)(const BatchColumns& columns, size_t begin, size_t end, double dt);
+
+// Kernels compiled with wider instruction sets, or nullptr when the
+// compiler was not allowed to target them
+BatchKernel BatchKernelAVX2();
+BatchKernel BatchKernelAVX512();
+
+namespace {
+
+// Same math as Simulation::fixed_update for width robots at a time. Both
+// couplings are affine in torque, so the Newton solve collapses to its
+// closed form. State is written back in the same order fixed_update uses,
+// since the pendulum update reads the freshly advanced platform angle.
+template <typename Lanes>
+void step_lanes(const BatchColumns& c, size_t begin, size_t end, double dt) {
+    using L = Lanes;
+    using value = typename L::value;
+
+    constexpr double PI = 3.1415926535;
+    constexpr double g = 9.81;
+
+    const value step = L::set(dt);
+    const value zero = L::set(0.0);
+    const value one = L::set(1.0);
+
+    const auto& dm = c.drive_motor;
+    const auto& tm = c.tilt_motor;
+
+    for (size_t i = begin; i + L::width <= end; i += L::width) {
+        value radius = L::load(c.radius + i);
+        value sphere_mass = L::load(c.sphere_mass + i);
+        value pendulum_mass = L::load(c.pendulum_mass + i);
+        value pendulum_length = L::load(c.pendulum_length + i);
+
+        value heading = L::load(c.heading + i);
+        value angular_velocity = L::load(c.angular_velocity + i);
+        value tilt = L::load(c.tilt + i);
+        value tilt_velocity = L::load(c.tilt_velocity + i);
+        value platform_angle = L::load(c.platform_angle + i);
+        value pendulum_angle = L::load(c.pendulum_angle + i);
+
+        value sin_tilt, cos_tilt, sin_heading, cos_heading, sin_platform, cos_platform, sin_pendulum, cos_pendulum;
+        L::sincos(tilt, sin_tilt, cos_tilt);
+        L::sincos(heading, sin_heading, cos_heading);
+        L::sincos(platform_angle, sin_platform, cos_platform);
+        L::sincos(pendulum_angle, sin_pendulum, cos_pendulum);
+
+        // ground motion
+        value ground_speed = L::mul(L::mul(angular_velocity, sin_tilt), radius);
+        L::store(c.x + i, L::add(L::load(c.x + i), L::mul(L::mul(step, ground_speed), cos_heading)));
+        L::store(c.y + i, L::add(L::load(c.y + i), L::mul(L::mul(step, ground_speed), sin_heading)));
+        L::store(c.heading + i, L::add(heading, L::mul(L::mul(step, angular_velocity), cos_tilt)));
+
+        // body response, acceleration = k * torque + b
+        value sphere_denominator = L::mul(L::mul(radius, radius),
+            L::add(L::mul(L::set(2.0 / 3.0), sphere_mass),
+                L::mul(L::mul(L::add(sphere_mass, pendulum_mass), sin_tilt), sin_tilt)));
+        value pendulum_denominator = L::mul(L::mul(pendulum_mass, pendulum_length), pendulum_length);
+        value pendulum_weight = L::mul(L::mul(pendulum_length, pendulum_mass), L::set(g));
+
+        value drive_offset = L::div(L::sub(zero, L::mul(L::mul(L::mul(radius, cos_tilt), angular_velocity), tilt_velocity)), sphere_denominator);
+        value platform_offset = L::div(L::sub(zero, L::mul(L::mul(cos_pendulum, sin_platform), pendulum_weight)), pendulum_denominator);
+        value tilt_denominator = L::mul(L::mul(L::set(2.0), sphere_mass), L::mul(radius, radius));
+        value pendulum_offset = L::div(L::sub(zero, L::mul(L::mul(cos_platform, sin_pendulum), pendulum_weight)), pendulum_denominator);
+
+        value drive_k = L::add(L::div(one, sphere_denominator), L::div(one, pendulum_denominator));
+        value drive_b = L::add(drive_offset, platform_offset);
+        value tilt_k = L::add(L::div(L::set(3.0), tilt_denominator), L::div(one, pendulum_denominator));
+        value tilt_b = pendulum_offset;
+
+        // motor assembly response, as seen through the gearbox
+        value drive_ratio = L::load(c.drive_ratio + i);
+        value drive_damping = L::load(c.drive_damping + i);
+        value drive_motor_velocity = L::load(c.drive_motor_velocity + i);
+        value drive_current = L::load(c.drive_current + i);
+
+        value tilt_ratio = L::load(c.tilt_ratio + i);
+        value tilt_damping = L::load(c.tilt_damping + i);
+        value tilt_motor_velocity = L::load(c.tilt_motor_velocity + i);
+        value tilt_current = L::load(c.tilt_current + i);
+
+        // gearbox velocity always equals the motor velocity after an update
+        value drive_free = L::sub(L::sub(L::mul(L::set(dm.Kt), drive_current), L::mul(L::set(dm.damping), drive_motor_velocity)),
+            L::div(L::mul(drive_damping, drive_motor_velocity), drive_ratio));
+        value drive_out_k = L::div(L::set(-1.0 / dm.inertia), L::mul(drive_ratio, drive_ratio));
+        value drive_out_b = L::div(drive_free, L::mul(L::set(dm.inertia), drive_ratio));
+
+        value tilt_free = L::sub(L::sub(L::mul(L::set(tm.Kt), tilt_current), L::mul(L::set(tm.damping), tilt_motor_velocity)),
+            L::div(L::mul(tilt_damping, tilt_motor_velocity), tilt_ratio));
+        value tilt_out_k = L::div(L::set(-1.0 / tm.inertia), L::mul(tilt_ratio, tilt_ratio));
+        value tilt_out_b = L::div(tilt_free, L::mul(L::set(tm.inertia), tilt_ratio));
+
+        // negotiate torque
+        value torque_m = L::div(L::sub(drive_out_b, drive_b), L::sub(drive_k, drive_out_k));
+        value torque_p = L::div(L::sub(tilt_out_b, tilt_b), L::sub(tilt_k, tilt_out_k));
+
+        // motors
+        value drive_voltage = L::sub(L::set(1 * PI), angular_velocity);
+        value drive_motor_torque = L::div(L::add(torque_m, L::mul(drive_damping, drive_motor_velocity)), drive_ratio);
+        value drive_dw = L::div(L::sub(L::sub(L::mul(L::set(dm.Kt), drive_current), L::mul(L::set(dm.damping), drive_motor_velocity)), drive_motor_torque), L::set(dm.inertia));
+        value drive_dI = L::div(L::sub(L::sub(drive_voltage, L::mul(L::set(dm.Kv), drive_motor_velocity)), L::mul(L::set(dm.resistance), drive_current)), L::set(dm.inductance));
+        L::store(c.drive_motor_velocity + i, L::add(drive_motor_velocity, L::mul(drive_dw, step)));
+        L::store(c.drive_current + i, L::add(drive_current, L::mul(drive_dI, step)));
+
+        value tilt_voltage = L::sub(L::mul(L::set(5.0), L::sub(L::set(0.4 * PI), tilt)), L::mul(L::set(10.0), tilt_velocity));
+        value tilt_motor_torque = L::div(L::add(torque_p, L::mul(tilt_damping, tilt_motor_velocity)), tilt_ratio);
+        value tilt_dw = L::div(L::sub(L::sub(L::mul(L::set(tm.Kt), tilt_current), L::mul(L::set(tm.damping), tilt_motor_velocity)), tilt_motor_torque), L::set(tm.inertia));
+        value tilt_dI = L::div(L::sub(L::sub(tilt_voltage, L::mul(L::set(tm.Kv), tilt_motor_velocity)), L::mul(L::set(tm.resistance), tilt_current)), L::set(tm.inductance));
+        L::store(c.tilt_motor_velocity + i, L::add(tilt_motor_velocity, L::mul(tilt_dw, step)));
+        L::store(c.tilt_current + i, L::add(tilt_current, L::mul(tilt_dI, step)));
+
+        // sphere and pendulum
+        value drive_acceleration = L::div(L::sub(torque_m, L::mul(L::mul(L::mul(radius, cos_tilt), angular_velocity), tilt_velocity)), sphere_denominator);
+        angular_velocity = L::add(angular_velocity, L::mul(step, drive_acceleration));
+        L::store(c.angular_velocity + i, angular_velocity);
+        L::store(c.roll + i, L::add(L::load(c.roll + i), L::mul(step, angular_velocity)));
+
+        tilt_velocity = L::add(tilt_velocity, L::mul(step, L::div(L::mul(L::set(3.0), torque_p), tilt_denominator)));
+        L::store(c.tilt_velocity + i, tilt_velocity);
+        L::store(c.tilt + i, L::add(tilt, L::mul(step, tilt_velocity)));
+
+        value platform_acceleration = L::div(L::sub(torque_m, L::mul(L::mul(cos_pendulum, sin_platform), pendulum_weight)), pendulum_denominator);
+        value platform_velocity = L::add(L::load(c.platform_velocity + i), L::mul(step, platform_acceleration));
+        platform_angle = L::add(platform_angle, L::mul(step, platform_velocity));
+        L::store(c.platform_velocity + i, platform_velocity);
+        L::store(c.platform_angle + i, platform_angle);
+
+        value new_sin_platform, new_cos_platform;
+        L::sincos(platform_angle, new_sin_platform, new_cos_platform);
+
+        value pendulum_acceleration = L::div(L::sub(torque_p, L::mul(L::mul(new_cos_platform, sin_pendulum), pendulum_weight)), pendulum_denominator);
+        value pendulum_velocity = L::add(L::load(c.pendulum_velocity + i), L::mul(step, pendulum_acceleration));
+        L::store(c.pendulum_velocity + i, pendulum_velocity);
+        L::store(c.pendulum_angle + i, L::add(pendulum_angle, L::mul(step, pendulum_velocity)));
+    }
+}
+
+// Vector kernel over whole lane groups, scalar kernel for the remainder
+template <typename Lanes>
+void step_batch(const BatchColumns& columns, size_t begin, size_t end, double dt) {
+    size_t vector_end = begin + (end - begin) / Lanes::width * Lanes::width;
+
+    step_lanes<Lanes>(columns, begin, vector_end, dt);
+    step_lanes<ScalarLanes>(columns, vector_end, end, dt);
+}
+
+}
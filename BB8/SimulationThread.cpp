@@ -0,0 +1,75 @@
+#include "SimulationThread.h"
+
+#include <chrono>
+
+SimulationThread::SimulationThread(Simulation& simulation, double tick_rate)
+    : simulation(simulation), tick_period(1.0 / tick_rate), time(0.0), running(false) {}
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start() {
+    if (running) {
+        return;
+    }
+
+    publish();
+
+    running = true;
+    worker = std::thread([this]() { run(); });
+}
+
+void SimulationThread::stop() {
+    running = false;
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+const SimulationThread::State& SimulationThread::latest() {
+    states.acquire();
+    return states.read_buffer();
+}
+
+void SimulationThread::run() {
+    using clock = std::chrono::steady_clock;
+
+    auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(tick_period));
+    auto max_lag = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(MAX_LAG));
+    auto next_tick = clock::now() + period;
+
+    while (running) {
+        std::this_thread::sleep_until(next_tick);
+
+        auto now = clock::now();
+
+        // if too far behind, run slow rather than never catching up
+        if (now - next_tick > max_lag) {
+            next_tick = now;
+        }
+
+        // every tick advances the same simulated time, catching up if late
+        while (next_tick <= now && running) {
+            simulation.update(tick_period);
+            time += tick_period;
+            publish();
+
+            next_tick += period;
+        }
+    }
+}
+
+void SimulationThread::publish() {
+    State& state = states.write_buffer();
+
+    state.position = simulation.get_position();
+    state.rotation = simulation.get_rotation();
+    state.platform_rotation = simulation.get_platform_rotation();
+    state.pendulum_rotation = simulation.get_pendulum_rotation();
+    state.heading = simulation.get_heading();
+    state.time = time;
+
+    states.publish();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "Quaternion.h"
+#include "Simulation.h"
+#include "TripleBuffer.h"
+#include "Vector3.h"
+
+// Steps a simulation in real time on its own thread, publishing its state
+// after every tick. The renderer reads the latest state without locking, so
+// neither side's frame time depends on the other's.
+class SimulationThread
+{
+public:
+    // What the renderer needs from one tick
+    class State {
+    public:
+        Vector3 position = Vector3(0.0, 0.0, 0.0);
+        Quaternion rotation = Quaternion::Identity();
+        Quaternion platform_rotation = Quaternion::Identity();
+        Quaternion pendulum_rotation = Quaternion::Identity();
+        double heading = 0.0;
+
+        // simulated time since start
+        double time = 0.0;
+    };
+
+    // The simulation must only be touched by this thread while it runs.
+    // tick_rate is in ticks per second of wall time.
+    SimulationThread(Simulation& simulation, double tick_rate = 1000.0);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // Publishes the initial state, then starts ticking
+    void start();
+    void stop();
+
+    // Most recently published state, for the one consuming thread
+    const State& latest();
+
+private:
+    // simulated time dropped when the thread falls further behind than this
+    static constexpr double MAX_LAG = 0.1;
+
+    Simulation& simulation;
+    const double tick_period;
+
+    TripleBuffer<State> states;
+    double time;
+
+    std::atomic<bool> running;
+    std::thread worker;
+
+    void run();
+    void publish();
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Byte-level helpers for versioned binary snapshots. Values are copied in
+// native byte order, which is little-endian on every target we build for.
+
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(std::vector<uint8_t>& buffer)
+        : buffer(buffer) {}
+
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values must be plain data");
+
+        size_t offset = buffer.size();
+        buffer.resize(offset + sizeof(T));
+        std::memcpy(buffer.data() + offset, &value, sizeof(T));
+    }
+
+private:
+    std::vector<uint8_t>& buffer;
+};
+
+class SnapshotReader
+{
+public:
+    SnapshotReader(const uint8_t* data, size_t size)
+        : data(data), size(size), offset(0), failed(false) {}
+
+    // Leaves value untouched and fails every later read once data runs out
+    template <typename T>
+    bool read(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values must be plain data");
+
+        if (failed || size - offset < sizeof(T)) {
+            failed = true;
+            return false;
+        }
+
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    bool ok() const { return !failed; }
+    bool at_end() const { return offset == size; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t offset;
+    bool failed;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cmath>
+#include <tuple>
+
+#include "TorqueSolver.h"
+
+// Compile-time counterparts of TorqueInterface and TorqueCoupling. An interface
+// is any type with acceleration(torque) and inertia(torque) members; holding
+// concrete types instead of std::function lets the whole Newton loop inline.
+
+// Interface over two concrete callables, e.g. lambdas
+template <typename AccelerationFn, typename InertiaFn>
+class StaticTorqueInterface
+{
+public:
+    StaticTorqueInterface(AccelerationFn acceleration_fn, InertiaFn inertia_fn, bool affine = false)
+        : acceleration_fn(acceleration_fn), inertia_fn(inertia_fn), is_affine(affine) {}
+
+    // resultant angular acceleration, given torque
+    double acceleration(double torque) const {
+        return acceleration_fn(torque);
+    }
+
+    // derivative of angular acceleration with respect to torque
+    double inertia(double torque) const {
+        return inertia_fn(torque);
+    }
+
+    bool affine() const {
+        return is_affine;
+    }
+
+private:
+    const AccelerationFn acceleration_fn;
+    const InertiaFn inertia_fn;
+    const bool is_affine;
+};
+
+template <typename AccelerationFn, typename InertiaFn>
+StaticTorqueInterface<AccelerationFn, InertiaFn> MakeTorqueInterface(AccelerationFn acceleration_fn, InertiaFn inertia_fn, bool affine = false) {
+    return StaticTorqueInterface<AccelerationFn, InertiaFn>(acceleration_fn, inertia_fn, affine);
+}
+
+// Non-owning interface to an object that changes state between solves, such as a MotorAssembly
+template <typename T>
+class TorqueInterfaceRef
+{
+public:
+    TorqueInterfaceRef(const T* target) : target(target) {}
+
+    double acceleration(double torque) const {
+        return target->acceleration(torque);
+    }
+
+    double inertia(double torque) const {
+        return target->inertia(torque);
+    }
+
+    bool affine() const {
+        return IsAffine(*target);
+    }
+
+private:
+    const T* target;
+};
+
+template <typename Input, typename Output>
+class StaticTorqueCoupling
+{
+public:
+    StaticTorqueCoupling(Input input, Output output, SolverOptions options = SolverOptions())
+        : input(input), output(output), options(options), last_input_torque(0.0) {}
+
+    // returns negotiated torque and resulting acceleration
+    std::pair<double, double> solve() {
+        if (std::isnan(last_input_torque)) {
+            last_input_torque = 0.0;
+        }
+
+        last_report = SolveTorque(input, output, last_input_torque, options);
+        if (last_report.converged) {
+            last_input_torque = last_report.torque;
+        }
+
+        return { last_report.torque, last_report.acceleration };
+    }
+
+    // convergence details of the most recent solve
+    const SolverReport& report() const {
+        return last_report;
+    }
+
+    // torque the next solve starts from, for snapshots
+    double last_torque() const {
+        return last_input_torque;
+    }
+
+    void set_last_torque(double torque) {
+        last_input_torque = torque;
+    }
+
+private:
+    const Input input;
+    const Output output;
+    const SolverOptions options;
+
+    double last_input_torque;
+    SolverReport last_report;
+};
+
+template <typename Input, typename Output>
+StaticTorqueCoupling<Input, Output> MakeTorqueCoupling(Input input, Output output) {
+    return StaticTorqueCoupling<Input, Output>(input, output);
+}
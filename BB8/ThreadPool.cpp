@@ -0,0 +1,86 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t thread_count)
+    : current_task(nullptr), task_count(0), next_index(0),
+      active_workers(0), generation(0), stopping(false) {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // calling thread is the last worker
+    for (size_t i = 1; i < thread_count; i++) {
+        workers.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    work_available.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const {
+    return workers.size() + 1;
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_task = &task;
+        task_count = count;
+        next_index = 0;
+        active_workers = workers.size();
+        generation++;
+    }
+
+    work_available.notify_all();
+    run_tasks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_finished.wait(lock, [this]() { return active_workers == 0; });
+    current_task = nullptr;
+}
+
+void ThreadPool::worker_loop() {
+    size_t seen_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_available.wait(lock, [&]() { return stopping || generation != seen_generation; });
+
+            if (stopping) {
+                return;
+            }
+
+            seen_generation = generation;
+        }
+
+        run_tasks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--active_workers == 0) {
+            work_finished.notify_one();
+        }
+    }
+}
+
+void ThreadPool::run_tasks() {
+    // tasks are claimed one index at a time, so uneven workloads balance themselves
+    for (size_t i = next_index++; i < task_count; i = next_index++) {
+        (*current_task)(i);
+    }
+}
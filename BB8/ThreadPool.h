@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops
+class ThreadPool
+{
+public:
+    // thread_count of 0 uses one thread per hardware core
+    ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const;
+
+    // Runs task(i) for every i in [0, count), blocking until all have finished.
+    // The calling thread takes part, so size() tasks run concurrently.
+    void parallel_for(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_finished;
+
+    const std::function<void(size_t)>* current_task;
+    size_t task_count;
+    std::atomic<size_t> next_index;
+    size_t active_workers;
+    size_t generation;
+    bool stopping;
+
+    void worker_loop();
+    void run_tasks();
+};
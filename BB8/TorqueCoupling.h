@@ -4,19 +4,29 @@
 #include <tuple>
 
 #include "TorqueInterface.h"
+#include "TorqueSolver.h"
 
+// Type-erased coupling for interfaces composed at runtime,
+// see StaticTorqueCoupling for the inlinable equivalent
 class TorqueCoupling
 {
 public:
-    TorqueCoupling(TorqueInterface input, TorqueInterface output);
+    TorqueCoupling(TorqueInterface input, TorqueInterface output, SolverOptions options = SolverOptions());
 
     std::pair<double, double> solve();
 
+    // convergence details of the most recent solve
+    const SolverReport& report() const;
+
+    // torque the next solve starts from, for snapshots
+    double last_torque() const;
+    void set_last_torque(double torque);
+
 private:
     const TorqueInterface input;
     const TorqueInterface output;
+    const SolverOptions options;
 
     double last_input_torque;
-
-    double newton(double initial_value, size_t iterations = 4) const;
+    SolverReport last_report;
 };
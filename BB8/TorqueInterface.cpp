@@ -1,7 +1,7 @@
 #include "TorqueInterface.h"
 
-TorqueInterface::TorqueInterface(std::function<double(double)> acceleration_fn, std::function<double(double)> inertia_fn)
-    : acceleration_fn(acceleration_fn), inertia_fn(inertia_fn) { }
+TorqueInterface::TorqueInterface(std::function<double(double)> acceleration_fn, std::function<double(double)> inertia_fn, bool affine)
+    : acceleration_fn(acceleration_fn), inertia_fn(inertia_fn), is_affine(affine) { }
 
 double TorqueInterface::acceleration(double torque) const {
     return acceleration_fn(torque);
@@ -10,3 +10,7 @@ double TorqueInterface::acceleration(double torque) const {
 double TorqueInterface::inertia(double torque) const {
     return inertia_fn(torque);
 }
+
+bool TorqueInterface::affine() const {
+    return is_affine;
+}
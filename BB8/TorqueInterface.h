@@ -5,7 +5,8 @@
 class TorqueInterface
 {
 public:
-    TorqueInterface(std::function<double(double)> acceleration_fn, std::function<double(double)> inertia_fn);
+    // affine marks acceleration as linear in torque, letting couplings solve in closed form
+    TorqueInterface(std::function<double(double)> acceleration_fn, std::function<double(double)> inertia_fn, bool affine = false);
 
     // resultant angular acceleration, given torque
     double acceleration(double torque) const;
@@ -13,7 +14,10 @@ public:
     // derivative of angular acceleration with respect to torque
     double inertia(double torque) const;
 
+    bool affine() const;
+
 private:
     const std::function<double(double)> acceleration_fn;
     const std::function<double(double)> inertia_fn;
+    const bool is_affine;
 };
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+// Finds the torque at which an input and output interface agree on acceleration.
+// Interfaces that are affine in torque (acceleration = k * torque + b) may say
+// so with a bool affine() const member, and are then solved in closed form.
+
+class SolverOptions {
+public:
+    // converged once |input - output acceleration| falls below this
+    double residual_tolerance = 1e-9;
+    // or once a step moves torque by less than this, relative to 1 + |torque|
+    double step_tolerance = 1e-12;
+
+    size_t max_iterations = 50;
+};
+
+class SolverReport {
+public:
+    double torque = 0.0;
+    double acceleration = 0.0;
+
+    size_t iterations = 0;
+    // |input - output acceleration| at the returned torque
+    double residual = 0.0;
+
+    bool converged = false;
+    bool closed_form = false;
+};
+
+namespace torque_solver_detail {
+
+template <typename T, typename = void>
+struct has_affine : std::false_type {};
+
+template <typename T>
+struct has_affine<T, decltype(void(std::declval<const T&>().affine()))> : std::true_type {};
+
+}
+
+template <typename T>
+bool IsAffine(const T& torque_interface) {
+    if constexpr (torque_solver_detail::has_affine<T>::value) {
+        return torque_interface.affine();
+    } else {
+        return false;
+    }
+}
+
+template <typename Input, typename Output>
+SolverReport SolveTorque(const Input& input, const Output& output, double initial_value, const SolverOptions& options = SolverOptions()) {
+    auto f = [&](double torque) { return input.acceleration(torque) - output.acceleration(torque); };
+    auto df = [&](double torque) { return input.inertia(torque) - output.inertia(torque); };
+
+    SolverReport report;
+    double x = std::isfinite(initial_value) ? initial_value : 0.0;
+
+    auto finish = [&](double torque, bool converged) {
+        report.torque = torque;
+        report.acceleration = input.acceleration(torque);
+        report.residual = std::fabs(report.acceleration - output.acceleration(torque));
+        report.converged = converged && std::isfinite(report.residual);
+        return report;
+    };
+
+    constexpr double min_slope = std::numeric_limits<double>::min() / std::numeric_limits<double>::epsilon();
+
+    // one Newton step is exact for affine interfaces
+    if (IsAffine(input) && IsAffine(output)) {
+        report.closed_form = true;
+        report.iterations = 1;
+
+        double slope = df(x);
+        if (std::fabs(slope) < min_slope) {
+            // no unique solution, keep the previous torque
+            return finish(x, false);
+        }
+
+        return finish(x - f(x) / slope, true);
+    }
+
+    // Newton's method, safeguarded in two ways: without a bracket around the
+    // root, steps are damped until |f| decreases, and if that fails the solver
+    // searches outwards for a sign change. Once bracketed, any Newton step that
+    // would leave the bracket is replaced by bisection.
+    bool have_low = false, have_high = false;
+    double low = 0.0, high = 0.0;  // f(low) < 0 < f(high)
+    double value = f(x);
+
+    for (size_t i = 0; i < options.max_iterations && std::isfinite(value); i++) {
+        report.iterations = i + 1;
+
+        if (std::fabs(value) <= options.residual_tolerance) {
+            return finish(x, true);
+        }
+
+        if (value < 0.0) {
+            low = x;
+            have_low = true;
+        } else {
+            high = x;
+            have_high = true;
+        }
+
+        double slope = df(x);
+        bool newton_ok = std::isfinite(slope) && std::fabs(slope) >= min_slope;
+        double step = newton_ok ? -value / slope : 0.0;
+        double previous = x;
+
+        if (have_low && have_high) {
+            double next = x + step;
+            if (!newton_ok || !(next > std::min(low, high) && next < std::max(low, high))) {
+                next = 0.5 * (low + high);
+            }
+
+            x = next;
+            value = f(x);
+
+            if (std::fabs(high - low) <= options.step_tolerance * (1.0 + std::fabs(x))) {
+                return finish(x, true);
+            }
+        } else {
+            bool improved = false;
+
+            for (int halving = 0; newton_ok && halving < 16 && std::isfinite(step); halving++) {
+                double trial_value = f(x + step);
+
+                if (std::fabs(trial_value) < std::fabs(value) || (trial_value < 0.0) != (value < 0.0)) {
+                    x = x + step;
+                    value = trial_value;
+                    improved = true;
+                    break;
+                }
+
+                step *= 0.5;
+            }
+
+            if (!improved) {
+                // stationary point or local minimum of |f|, look for a sign change
+                bool found = false;
+                for (double reach = 1.0 + std::fabs(x); !found && std::isfinite(reach) && reach < 1e12 * (1.0 + std::fabs(x)); reach *= 2.0) {
+                    for (double trial : { x + reach, x - reach }) {
+                        double trial_value = f(trial);
+                        if (std::isfinite(trial_value) && (trial_value < 0.0) != (value < 0.0)) {
+                            x = trial;
+                            value = trial_value;
+                            found = true;
+                            break;
+                        }
+                    }
+                }
+
+                if (!found) {
+                    return finish(previous, false);
+                }
+            }
+        }
+
+        if (std::fabs(x - previous) <= options.step_tolerance * (1.0 + std::fabs(previous))) {
+            return finish(x, std::fabs(value) <= options.residual_tolerance);
+        }
+    }
+
+    return finish(x, false);
+}
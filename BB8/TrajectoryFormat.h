@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout shared by TrajectoryRecorder and TrajectoryReader.
+//
+// A fixed header is followed by chunks of chunk_rows rows of doubles. Within
+// a chunk every column is stored contiguously, in TrajectoryColumn order, so
+// a column can be scanned a chunk at a time and any value located by
+// arithmetic alone. The last chunk is padded to full size.
+
+enum class TrajectoryColumn : uint32_t {
+    Time,
+    PositionX, PositionY, PositionZ,
+    // Simulation::get_rotation
+    RotationR, RotationA, RotationB, RotationC,
+    // Simulation::get_platform_rotation
+    PlatformR, PlatformA, PlatformB, PlatformC,
+    // Simulation::get_pendulum_rotation
+    PendulumR, PendulumA, PendulumB, PendulumC,
+    DriveTorque, TiltTorque,
+    DriveVoltage, TiltVoltage,
+    DriveCurrent, TiltCurrent,
+    Count
+};
+
+class TrajectoryHeader {
+public:
+    static constexpr uint32_t MAGIC = 0x54384242; // "BB8T"
+    static constexpr uint32_t VERSION = 1;
+    // row_count of a file whose recorder never closed it
+    static constexpr uint64_t UNFINISHED = ~uint64_t(0);
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t column_count;
+    uint32_t chunk_rows;
+    uint64_t row_count;
+    uint64_t reserved;
+};
@@ -0,0 +1,217 @@
+#include "TrajectoryReader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+constexpr size_t COLUMN_COUNT = static_cast<size_t>(TrajectoryColumn::Count);
+
+TrajectoryReader::TrajectoryReader(const std::string& path)
+    : data(nullptr), size(0), row_count(0), chunk_count(0), rows_per_chunk(0),
+#ifdef _WIN32
+      file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#else
+      file(-1)
+#endif
+{
+    map(path);
+
+    TrajectoryHeader header;
+    if (!data || size < sizeof(header)) {
+        unmap();
+        return;
+    }
+
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.magic != TrajectoryHeader::MAGIC || header.version != TrajectoryHeader::VERSION
+        || header.column_count != COLUMN_COUNT || header.chunk_rows == 0) {
+        unmap();
+        return;
+    }
+
+    rows_per_chunk = header.chunk_rows;
+
+    size_t chunk_bytes = COLUMN_COUNT * rows_per_chunk * sizeof(double);
+    size_t complete_chunks = (size - sizeof(header)) / chunk_bytes;
+
+    if (header.row_count == TrajectoryHeader::UNFINISHED) {
+        row_count = complete_chunks * rows_per_chunk;
+    } else {
+        row_count = static_cast<size_t>(std::min<uint64_t>(header.row_count, complete_chunks * rows_per_chunk));
+    }
+
+    chunk_count = (row_count + rows_per_chunk - 1) / rows_per_chunk;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    unmap();
+}
+
+bool TrajectoryReader::is_open() const {
+    return data != nullptr;
+}
+
+size_t TrajectoryReader::rows() const {
+    return row_count;
+}
+
+size_t TrajectoryReader::chunks() const {
+    return chunk_count;
+}
+
+size_t TrajectoryReader::chunk_rows() const {
+    return rows_per_chunk;
+}
+
+size_t TrajectoryReader::rows_in_chunk(size_t chunk) const {
+    return std::min(rows_per_chunk, row_count - chunk * rows_per_chunk);
+}
+
+const double* TrajectoryReader::column(TrajectoryColumn column, size_t chunk) const {
+    size_t offset = sizeof(TrajectoryHeader)
+        + (chunk * COLUMN_COUNT + static_cast<size_t>(column)) * rows_per_chunk * sizeof(double);
+
+    return reinterpret_cast<const double*>(data + offset);
+}
+
+double TrajectoryReader::value(TrajectoryColumn column, size_t row) const {
+    return this->column(column, row / rows_per_chunk)[row % rows_per_chunk];
+}
+
+double TrajectoryReader::time(size_t row) const {
+    return value(TrajectoryColumn::Time, row);
+}
+
+Vector3 TrajectoryReader::position(size_t row) const {
+    return Vector3(
+        value(TrajectoryColumn::PositionX, row),
+        value(TrajectoryColumn::PositionY, row),
+        value(TrajectoryColumn::PositionZ, row));
+}
+
+Quaternion TrajectoryReader::rotation(size_t row) const {
+    return quaternion(TrajectoryColumn::RotationR, row);
+}
+
+Quaternion TrajectoryReader::platform_rotation(size_t row) const {
+    return quaternion(TrajectoryColumn::PlatformR, row);
+}
+
+Quaternion TrajectoryReader::pendulum_rotation(size_t row) const {
+    return quaternion(TrajectoryColumn::PendulumR, row);
+}
+
+const char* TrajectoryReader::ColumnName(TrajectoryColumn column) {
+    static const char* names[COLUMN_COUNT] = {
+        "time",
+        "x", "y", "z",
+        "rotation_r", "rotation_a", "rotation_b", "rotation_c",
+        "platform_r", "platform_a", "platform_b", "platform_c",
+        "pendulum_r", "pendulum_a", "pendulum_b", "pendulum_c",
+        "drive_torque", "tilt_torque",
+        "drive_voltage", "tilt_voltage",
+        "drive_current", "tilt_current",
+    };
+
+    return names[static_cast<size_t>(column)];
+}
+
+Quaternion TrajectoryReader::quaternion(TrajectoryColumn first, size_t row) const {
+    size_t index = static_cast<size_t>(first);
+
+    return Quaternion::FromComponents(
+        value(static_cast<TrajectoryColumn>(index + 0), row),
+        value(static_cast<TrajectoryColumn>(index + 1), row),
+        value(static_cast<TrajectoryColumn>(index + 2), row),
+        value(static_cast<TrajectoryColumn>(index + 3), row));
+}
+
+#ifdef _WIN32
+
+void TrajectoryReader::map(const std::string& path) {
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        return;
+    }
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        return;
+    }
+
+    data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    size = data ? static_cast<size_t>(file_size.QuadPart) : 0;
+}
+
+void TrajectoryReader::unmap() {
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+
+    data = nullptr;
+    size = 0;
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+void TrajectoryReader::map(const std::string& path) {
+    file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return;
+    }
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        return;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+    if (view == MAP_FAILED) {
+        return;
+    }
+
+    data = static_cast<const uint8_t*>(view);
+    size = static_cast<size_t>(status.st_size);
+}
+
+void TrajectoryReader::unmap() {
+    if (data) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+
+    if (file >= 0) {
+        ::close(file);
+    }
+
+    data = nullptr;
+    size = 0;
+    file = -1;
+}
+
+#endif
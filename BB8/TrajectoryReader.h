@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Quaternion.h"
+#include "TrajectoryFormat.h"
+#include "Vector3.h"
+
+// Memory-mapped view of a file written by TrajectoryRecorder. Nothing is read
+// up front, so opening a multi-hour recording is immediate and pages are
+// only brought in as they are touched. A file whose recorder never closed
+// it exposes its complete chunks.
+class TrajectoryReader
+{
+public:
+    // Check is_open before reading
+    explicit TrajectoryReader(const std::string& path);
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    bool is_open() const;
+
+    size_t rows() const;
+    size_t chunks() const;
+    size_t chunk_rows() const;
+    size_t rows_in_chunk(size_t chunk) const;
+
+    // Contiguous values of one column within a chunk, rows_in_chunk of them
+    const double* column(TrajectoryColumn column, size_t chunk) const;
+    double value(TrajectoryColumn column, size_t row) const;
+
+    double time(size_t row) const;
+    Vector3 position(size_t row) const;
+    Quaternion rotation(size_t row) const;
+    Quaternion platform_rotation(size_t row) const;
+    Quaternion pendulum_rotation(size_t row) const;
+
+    static const char* ColumnName(TrajectoryColumn column);
+
+private:
+    const uint8_t* data;
+    size_t size;
+
+    size_t row_count;
+    size_t chunk_count;
+    size_t rows_per_chunk;
+
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+
+    void map(const std::string& path);
+    void unmap();
+
+    Quaternion quaternion(TrajectoryColumn first, size_t row) const;
+};
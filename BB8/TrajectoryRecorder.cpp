@@ -0,0 +1,215 @@
+#include "TrajectoryRecorder.h"
+
+#include <algorithm>
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string& path, size_t chunk_rows)
+    : file(std::fopen(path.c_str(), "wb")),
+      chunk_rows(std::max<size_t>(1, chunk_rows)),
+      time(0.0),
+      row_count(0),
+      current(),
+      stopping(false),
+      failed(false) {
+    if (!file) {
+        failed = true;
+        return;
+    }
+
+    // rewritten with the row count on close
+    write_header(TrajectoryHeader::UNFINISHED);
+
+    current.reset(new Chunk{ std::vector<double>(RAW_COUNT * this->chunk_rows), 0 });
+    writer = std::thread([this]() { writer_loop(); });
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    close();
+}
+
+bool TrajectoryRecorder::is_open() const {
+    return file != nullptr;
+}
+
+bool TrajectoryRecorder::ok() const {
+    return !failed;
+}
+
+size_t TrajectoryRecorder::rows() const {
+    return row_count;
+}
+
+void TrajectoryRecorder::record(const Simulation& simulation, double dt) {
+    if (!current) {
+        return;
+    }
+
+    auto telemetry = simulation.get_telemetry();
+    time += dt;
+
+    double* raw = current->raw.data() + current->rows;
+    raw[RAW_TIME * chunk_rows] = time;
+    raw[RAW_X * chunk_rows] = telemetry.position.X;
+    raw[RAW_Y * chunk_rows] = telemetry.position.Y;
+    raw[RAW_Z * chunk_rows] = telemetry.position.Z;
+    raw[RAW_ROLL * chunk_rows] = telemetry.roll;
+    raw[RAW_TILT * chunk_rows] = telemetry.tilt;
+    raw[RAW_HEADING * chunk_rows] = telemetry.heading;
+    raw[RAW_PLATFORM_ANGLE * chunk_rows] = telemetry.platform_angle;
+    raw[RAW_PENDULUM_ANGLE * chunk_rows] = telemetry.pendulum_angle;
+    raw[RAW_DRIVE_TORQUE * chunk_rows] = telemetry.drive_torque;
+    raw[RAW_TILT_TORQUE * chunk_rows] = telemetry.tilt_torque;
+    raw[RAW_DRIVE_VOLTAGE * chunk_rows] = telemetry.drive_voltage;
+    raw[RAW_TILT_VOLTAGE * chunk_rows] = telemetry.tilt_voltage;
+    raw[RAW_DRIVE_CURRENT * chunk_rows] = telemetry.drive_current;
+    raw[RAW_TILT_CURRENT * chunk_rows] = telemetry.tilt_current;
+
+    row_count++;
+
+    if (++current->rows == chunk_rows) {
+        submit();
+    }
+}
+
+Simulation::StepCallback TrajectoryRecorder::callback() {
+    return [this](const Simulation& simulation, double dt) { record(simulation, dt); };
+}
+
+void TrajectoryRecorder::close() {
+    if (!file) {
+        return;
+    }
+
+    if (current->rows > 0) {
+        submit();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    chunk_queued.notify_one();
+    writer.join();
+
+    write_header(row_count);
+
+    if (std::fclose(file) != 0) {
+        failed = true;
+    }
+
+    file = nullptr;
+    current.reset();
+}
+
+// Hands the current chunk to the writer and takes a spare one to fill
+void TrajectoryRecorder::submit() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // a writer that can't keep up slows recording rather than growing memory
+    chunk_written.wait(lock, [this]() { return pending.size() < MAX_PENDING; });
+
+    pending.push_back(std::move(current));
+
+    if (spare.empty()) {
+        current.reset(new Chunk{ std::vector<double>(RAW_COUNT * chunk_rows), 0 });
+    } else {
+        current = std::move(spare.back());
+        spare.pop_back();
+    }
+
+    current->rows = 0;
+
+    lock.unlock();
+    chunk_queued.notify_one();
+}
+
+void TrajectoryRecorder::writer_loop() {
+    std::vector<double> columns(static_cast<size_t>(TrajectoryColumn::Count) * chunk_rows);
+
+    while (true) {
+        std::unique_ptr<Chunk> chunk;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            chunk_queued.wait(lock, [this]() { return stopping || !pending.empty(); });
+
+            if (pending.empty()) {
+                return;
+            }
+
+            chunk = std::move(pending.front());
+            pending.pop_front();
+        }
+
+        write_chunk(*chunk, columns);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            spare.push_back(std::move(chunk));
+        }
+
+        chunk_written.notify_one();
+    }
+}
+
+void TrajectoryRecorder::write_chunk(const Chunk& chunk, std::vector<double>& columns) {
+    auto column = [&](TrajectoryColumn column) {
+        return columns.data() + static_cast<size_t>(column) * chunk_rows;
+    };
+    auto raw = [&](RawColumn column) {
+        return chunk.raw.data() + column * chunk_rows;
+    };
+
+    // padding rows of a final partial chunk
+    std::fill(columns.begin(), columns.end(), 0.0);
+
+    std::copy_n(raw(RAW_TIME), chunk.rows, column(TrajectoryColumn::Time));
+    std::copy_n(raw(RAW_X), chunk.rows, column(TrajectoryColumn::PositionX));
+    std::copy_n(raw(RAW_Y), chunk.rows, column(TrajectoryColumn::PositionY));
+    std::copy_n(raw(RAW_Z), chunk.rows, column(TrajectoryColumn::PositionZ));
+    std::copy_n(raw(RAW_DRIVE_TORQUE), chunk.rows, column(TrajectoryColumn::DriveTorque));
+    std::copy_n(raw(RAW_TILT_TORQUE), chunk.rows, column(TrajectoryColumn::TiltTorque));
+    std::copy_n(raw(RAW_DRIVE_VOLTAGE), chunk.rows, column(TrajectoryColumn::DriveVoltage));
+    std::copy_n(raw(RAW_TILT_VOLTAGE), chunk.rows, column(TrajectoryColumn::TiltVoltage));
+    std::copy_n(raw(RAW_DRIVE_CURRENT), chunk.rows, column(TrajectoryColumn::DriveCurrent));
+    std::copy_n(raw(RAW_TILT_CURRENT), chunk.rows, column(TrajectoryColumn::TiltCurrent));
+
+    auto store = [&](TrajectoryColumn first, size_t row, const Quaternion& q) {
+        size_t index = static_cast<size_t>(first);
+        columns[(index + 0) * chunk_rows + row] = q.R();
+        columns[(index + 1) * chunk_rows + row] = q.A();
+        columns[(index + 2) * chunk_rows + row] = q.B();
+        columns[(index + 3) * chunk_rows + row] = q.C();
+    };
+
+    for (size_t row = 0; row < chunk.rows; row++) {
+        Simulation::Telemetry telemetry;
+        telemetry.roll = raw(RAW_ROLL)[row];
+        telemetry.tilt = raw(RAW_TILT)[row];
+        telemetry.heading = raw(RAW_HEADING)[row];
+        telemetry.platform_angle = raw(RAW_PLATFORM_ANGLE)[row];
+        telemetry.pendulum_angle = raw(RAW_PENDULUM_ANGLE)[row];
+
+        store(TrajectoryColumn::RotationR, row, telemetry.rotation());
+        store(TrajectoryColumn::PlatformR, row, telemetry.platform_rotation());
+        store(TrajectoryColumn::PendulumR, row, telemetry.pendulum_rotation());
+    }
+
+    if (std::fwrite(columns.data(), sizeof(double), columns.size(), file) != columns.size()) {
+        failed = true;
+    }
+}
+
+void TrajectoryRecorder::write_header(uint64_t rows) {
+    TrajectoryHeader header;
+    header.magic = TrajectoryHeader::MAGIC;
+    header.version = TrajectoryHeader::VERSION;
+    header.column_count = static_cast<uint32_t>(TrajectoryColumn::Count);
+    header.chunk_rows = static_cast<uint32_t>(chunk_rows);
+    header.row_count = rows;
+    header.reserved = 0;
+
+    if (std::fseek(file, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, file) != 1) {
+        failed = true;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Simulation.h"
+#include "TrajectoryFormat.h"
+
+// Streams per-step simulation state to a columnar trajectory file, see
+// TrajectoryFormat.h. The simulation thread only copies raw telemetry into
+// a chunk; composing rotations, transposing and writing happen on a
+// background thread, which is handed each chunk as it fills.
+class TrajectoryRecorder
+{
+public:
+    // Check is_open before recording
+    TrajectoryRecorder(const std::string& path, size_t chunk_rows = 4096);
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    bool is_open() const;
+    // false once a write has failed
+    bool ok() const;
+    size_t rows() const;
+
+    // Appends the simulation's current state, dt after the previous row
+    void record(const Simulation& simulation, double dt);
+
+    // Records every step, for Simulation::set_step_callback
+    Simulation::StepCallback callback();
+
+    // Writes buffered rows and completes the header. Called on destruction.
+    void close();
+
+private:
+    // raw values the simulation thread copies, composed on the writer thread
+    enum RawColumn {
+        RAW_TIME, RAW_X, RAW_Y, RAW_Z,
+        RAW_ROLL, RAW_TILT, RAW_HEADING, RAW_PLATFORM_ANGLE, RAW_PENDULUM_ANGLE,
+        RAW_DRIVE_TORQUE, RAW_TILT_TORQUE,
+        RAW_DRIVE_VOLTAGE, RAW_TILT_VOLTAGE,
+        RAW_DRIVE_CURRENT, RAW_TILT_CURRENT,
+        RAW_COUNT
+    };
+
+    class Chunk {
+    public:
+        // column major, chunk_rows values per raw column
+        std::vector<double> raw;
+        size_t rows;
+    };
+
+    // chunks allowed to wait for the writer before record blocks
+    static constexpr size_t MAX_PENDING = 16;
+
+    std::FILE* file;
+    const size_t chunk_rows;
+
+    double time;
+    size_t row_count;
+    std::unique_ptr<Chunk> current;
+
+    std::mutex mutex;
+    std::condition_variable chunk_queued;
+    std::condition_variable chunk_written;
+    std::deque<std::unique_ptr<Chunk>> pending;
+    std::vector<std::unique_ptr<Chunk>> spare;
+    bool stopping;
+    std::atomic<bool> failed;
+
+    std::thread writer;
+
+    void submit();
+    void writer_loop();
+    void write_chunk(const Chunk& chunk, std::vector<double>& columns);
+    void write_header(uint64_t rows);
+};
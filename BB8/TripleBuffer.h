@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single producer, single consumer handoff of the latest value.
+// The producer fills write_buffer() and publishes it; the consumer acquires
+// the most recently published value whenever it likes. Neither side ever
+// waits for the other, and intermediate values the consumer was too slow to
+// see are simply replaced.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer()
+        : slots(), back(0), shared(1), front(2) {}
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Producer: buffer to fill before publish, holding stale data
+    T& write_buffer() {
+        return slots[back].value;
+    }
+
+    // Producer: makes write_buffer the latest value and takes a free buffer
+    void publish() {
+        back = shared.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Producer: publishes a copy of value
+    void write(const T& value) {
+        write_buffer() = value;
+        publish();
+    }
+
+    // Consumer: switches to the latest value if one was published since
+    // the last acquire, returning whether anything changed
+    bool acquire() {
+        if ((shared.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+
+        front = shared.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // Consumer: value as of the last acquire, default constructed before any
+    const T& read_buffer() const {
+        return slots[front].value;
+    }
+
+private:
+    static constexpr unsigned INDEX = 3;
+    static constexpr unsigned FRESH = 4;
+
+    // keep producer and consumer slots on separate cache lines
+    class alignas(64) Slot {
+    public:
+        T value;
+    };
+
+    Slot slots[3];
+
+    // slot index owned by each side, and the one in between tagged FRESH
+    // when it holds a value the consumer hasn't taken yet
+    alignas(64) unsigned back;
+    alignas(64) std::atomic<unsigned> shared;
+    alignas(64) unsigned front;
+};
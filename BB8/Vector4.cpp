@@ -3,11 +3,11 @@
 #include <cmath>
 
 Vector4 Vector4::Subtract(Vector4 minuend, Vector4 subtrahend) {
-    return Vector4(minuend.X - subtrahend.X, minuend.Y - subtrahend.Y, minuend.Z - subtrahend.Z, minuend.W);
+    return Vector4(minuend.X - subtrahend.X, minuend.Y - subtrahend.Y, minuend.Z - subtrahend.Z, minuend.W - subtrahend.W);
 }
 
 Vector4 Vector4::Add(Vector4 summand1, Vector4 summand2) {
-    return Vector4(summand1.X + summand2.X, summand1.Y + summand2.Y, summand1.Z + summand2.Z, summand1.W);
+    return Vector4(summand1.X + summand2.X, summand1.Y + summand2.Y, summand1.Z + summand2.Z, summand1.W + summand2.W);
 }
 
 Vector4 Vector4::Multiply(Vector4 multiplicand, double multiplier) {
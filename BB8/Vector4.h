@@ -4,6 +4,7 @@ class Vector4 {
 public:
     double X, Y, Z, W;
 
+    Vector4() : X(0.0), Y(0.0), Z(0.0), W(0.0) {};
     Vector4(double x, double y, double z, double w) : X(x), Y(y), Z(z), W(w) {};
 
     static Vector4 Subtract(Vector4 minuend, Vector4 subtrahend);
@@ -1,5 +1,6 @@
 #include "Visualization.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <sstream>
@@ -9,7 +10,19 @@
 
 constexpr double PI = 3.14159265358979323846;
 
-Visualization::Visualization()
+namespace {
+
+bool same(const Vector3& a, const Vector3& b) {
+    return a.X == b.X && a.Y == b.Y && a.Z == b.Z;
+}
+
+bool same(const Quaternion& a, const Quaternion& b) {
+    return a.R() == b.R() && a.A() == b.A() && a.B() == b.B() && a.C() == b.C();
+}
+
+}
+
+Visualization::Visualization(uint32_t shadow_map_size)
   : sphere_rotation(Quaternion::Identity()),
     platform_rotation(Quaternion::Identity()),
     pendulum_rotation(Quaternion::Identity()),
@@ -17,7 +30,10 @@ Visualization::Visualization()
     theta(0.0),
     heading(0.0),
     relative_camera_orientation(true),
-    wireframe_mode(false)
+    wireframe_mode(false),
+    sphere(128.0),
+    ground(1024.0),
+    shadow_map(shadow_map_size)
 {
     Lighting::Light primary;
     primary.diffuse = Color(0.8, 0.8, 0.8, 1.0);
@@ -25,10 +41,20 @@ Visualization::Visualization()
     primary.position = Vector3(25, 35, 15);
     lighting.AddLight(primary);
 
-    sphere = Robot(1.0, 12);
-    platform = Platform(0.9, 0.1);
-    pendulum = Pendulum(0.1, 0.7);
-    ground = Plane(2.0, 10);
+    // Densities from a few hundred triangles to tens of thousands, as the
+    // robot fills more of the screen
+    for (int density = 6; density <= 96; density *= 2) {
+        sphere.AddLevel(Robot(sphere_radius, density), 2.0 * PI * sphere_radius / density);
+    }
+
+    platform = RenderMesh(Platform(0.9, 0.1));
+    pendulum = RenderMesh(Pendulum(0.1, 0.7));
+
+    // The checkerboard is never coarser than its squares; subdividing them
+    // smooths the lighting across squares close to the camera
+    for (int subdivision = 1; subdivision <= 4; subdivision *= 2) {
+        ground.AddLevel(Plane(ground_square_size, ground_extent, subdivision), ground_square_size / subdivision);
+    }
     
     reset_view();
 }
@@ -38,10 +64,12 @@ void Visualization::reset_view() {
     camera.MoveTo(10.0, 0.0, PI/4.0);
 }
 
+#ifdef _WIN32
 void Visualization::OnKeyDown(WPARAM wParam, LPARAM lParam) {
     switch (wParam) {
     case 'M':
         wireframe_mode = !wireframe_mode;
+        scene_changed = true;
         break;
     case 'C':
         if (relative_camera_orientation) {
@@ -58,8 +86,7 @@ void Visualization::OnKeyDown(WPARAM wParam, LPARAM lParam) {
     }
 }
 
-void Visualization::Update(double elapsed_seconds, Vector3 sphere_location, Quaternion sphere_rotation,
-    Quaternion platform_rotation, Quaternion pendulum_rotation, double sphere_heading) {
+void Visualization::PollKeys() {
     auto [distance, ctheta, phi] = camera.State();
 
     SHORT high_bit_mask = 0x8000;
@@ -92,6 +119,14 @@ void Visualization::Update(double elapsed_seconds, Vector3 sphere_location, Quat
         distance = std::min(std::max(2.0, distance), 100.0);
     }
 
+    camera.MoveTo(distance, relative_camera_orientation ? theta + heading : theta, phi);
+}
+#endif
+
+void Visualization::Update(double elapsed_seconds, Vector3 sphere_location, Quaternion sphere_rotation,
+    Quaternion platform_rotation, Quaternion pendulum_rotation, double sphere_heading) {
+    auto [distance, ctheta, phi] = camera.State();
+
     if (relative_camera_orientation) {
         camera.MoveTo(distance, theta + sphere_heading, phi);
     } else {
@@ -101,6 +136,11 @@ void Visualization::Update(double elapsed_seconds, Vector3 sphere_location, Quat
     heading = sphere_heading;
     camera.PointAt(sphere_location);
 
+    if (!same(sphere_location, this->sphere_location) || !same(sphere_rotation, this->sphere_rotation)
+        || !same(platform_rotation, this->platform_rotation) || !same(pendulum_rotation, this->pendulum_rotation)) {
+        scene_changed = true;
+    }
+
     this->sphere_location = sphere_location;
     this->sphere_rotation = sphere_rotation;
     this->platform_rotation = platform_rotation;
@@ -108,15 +148,112 @@ void Visualization::Update(double elapsed_seconds, Vector3 sphere_location, Quat
 }
 
 void Visualization::Render(RenderDevice& renderDevice) {
-    renderDevice.Clear(Color(1.0, 1.0, 1.0, 1.0));
+    // Levels of detail go by the nearest point of each to the camera
+    Vector3 eye = camera.Position();
+    double ground_reach = ground_extent * ground_square_size;
+    Vector3 ground_point(std::min(ground_reach, std::max(-ground_reach, eye.X)), std::min(ground_reach, std::max(-ground_reach, eye.Y)), 0.0);
+
+    double sphere_distance = Vector3::Length(Vector3::Subtract(eye, sphere_location)) - sphere_radius;
+    double ground_distance = Vector3::Length(Vector3::Subtract(eye, ground_point));
+
+    const RenderMesh& sphere_mesh = sphere.Select(camera.PixelsPerUnit(std::max(sphere_distance, min_lod_distance), renderDevice.Height()));
+    const RenderMesh& ground_mesh = ground.Select(camera.PixelsPerUnit(std::max(ground_distance, min_lod_distance), renderDevice.Height()));
+
+    bool layer_changed = camera.Version() != layer_camera_version || lighting.Version() != layer_lighting_version
+        || &ground_mesh != layer_ground || swarm_changed;
+
+    if (layer_changed) {
+        layer_key++;
+        layer_camera_version = camera.Version();
+        layer_lighting_version = lighting.Version();
+        layer_ground = &ground_mesh;
+        swarm_changed = false;
+    }
+
+    // Nothing changed at all, so the device still shows this frame
+    if (!layer_changed && !scene_changed && renderDevice.HasLayer(layer_key)) {
+        return;
+    }
 
-    renderDevice.RenderSurface(camera, lighting, ground, Quaternion::Identity(), Vector3());
+    scene_changed = false;
+
+    // The sphere casts the shadow at whatever level it's drawn at, so the
+    // map is redrawn when either changes
+    shadow_map.Update(lighting.Lights().front(), sphere_mesh, sphere_rotation, sphere_location);
+
+    if (layer_changed) {
+        // While the view moves, a layer would seldom be used again. Opaque
+        // surfaces go nearest first, so the depth pyramid can skip what they
+        // hide of the ground.
+        renderDevice.Clear(Color(1.0, 1.0, 1.0, 1.0));
+        render_robot(renderDevice, sphere_mesh);
+        render_static(renderDevice, ground_mesh);
+    } else {
+        // The view stayed put since the last frame, so is kept once drawn
+        if (renderDevice.HasLayer(layer_key)) {
+            renderDevice.RestoreLayer();
+        } else {
+            renderDevice.Clear(Color(1.0, 1.0, 1.0, 1.0));
+            render_static(renderDevice, ground_mesh);
+            renderDevice.SaveLayer(layer_key);
+        }
+
+        render_robot(renderDevice, sphere_mesh);
+    }
+
+    // Then the shadow over the opaque surfaces, and translucent lines last
+    renderDevice.RenderShadow(camera, shadow_map, Vector4(0.0, 0.0, 1.0, 0.0));
 
+    if (wireframe_mode) {
+        renderDevice.RenderWireframe(camera, sphere_mesh, sphere_rotation, sphere_location, Color(0.0, 0.0, 0.0, 0.4), 5);
+    }
+
+    renderDevice.Flush();
+}
+
+void Visualization::render_robot(RenderDevice& renderDevice, const RenderMesh& sphere_mesh) {
+    // In wireframe mode, the sphere is drawn last, as lines over its insides
     if (wireframe_mode) {
         renderDevice.RenderSurface(camera, lighting, platform, platform_rotation, sphere_location);
         renderDevice.RenderSurface(camera, lighting, pendulum, pendulum_rotation, sphere_location);
-        renderDevice.RenderWireframe(camera, sphere, sphere_rotation, sphere_location, Color(0.0, 0.0, 0.0, 0.4), 5);
     } else {
-        renderDevice.RenderSurface(camera, lighting, sphere, sphere_rotation, sphere_location);
+        renderDevice.RenderSurface(camera, lighting, sphere_mesh, sphere_rotation, sphere_location);
+    }
+}
+
+void Visualization::render_static(RenderDevice& renderDevice, const RenderMesh& ground_mesh) {
+    render_swarm(renderDevice);
+    renderDevice.RenderSurface(camera, lighting, ground_mesh, Quaternion::Identity(), Vector3());
+}
+
+void Visualization::UpdateSwarm(const std::vector<RenderDevice::Instance>& robots) {
+    // levels only carry over while the members stay the same
+    if (robots.size() != swarm.size()) {
+        swarm_levels.assign(robots.size(), 0);
+    }
+
+    swarm = robots;
+    swarm_changed = true;
+}
+
+void Visualization::render_swarm(RenderDevice& renderDevice) {
+    swarm_batches.resize(sphere.LevelCount());
+    for (auto& batch : swarm_batches) {
+        batch.clear();
+    }
+
+    // Each level's members share its mesh, drawn as one batch
+    Vector3 eye = camera.Position();
+    for (size_t i = 0; i < swarm.size(); i++) {
+        double distance = Vector3::Length(Vector3::Subtract(eye, swarm[i].translation)) - sphere_radius;
+
+        swarm_levels[i] = sphere.LevelFor(camera.PixelsPerUnit(std::max(distance, min_lod_distance), renderDevice.Height()), swarm_levels[i]);
+        swarm_batches[swarm_levels[i]].push_back(swarm[i]);
+    }
+
+    for (size_t level = 0; level < swarm_batches.size(); level++) {
+        if (!swarm_batches[level].empty()) {
+            renderDevice.RenderInstances(camera, lighting, sphere.LevelMesh(level), swarm_batches[level]);
+        }
     }
 }
@@ -2,25 +2,48 @@
 
 #include <array>
 #include <tuple>
+#include <vector>
 
+#ifdef _WIN32
 #include "framework.h"
+#endif
+
 #include "RenderDevice.h"
 #include "Camera.h"
 #include "Lighting.h"
+#include "LodChain.h"
+#include "RenderMesh.h"
+#include "ShadowMap.h"
 
 class Visualization {
 public:
-    Visualization();
+    // shadow_map_size is the width and height of the robot's shadow map
+    Visualization(uint32_t shadow_map_size = 1024);
 
+#ifdef _WIN32
     void OnKeyDown(WPARAM wParam, LPARAM lParam);
+    // Pans and zooms the camera for the arrow and Z keys held down. Update
+    // doesn't read the keyboard, so offline rendering stays deterministic.
+    void PollKeys();
+#endif
     void Update(double elapsed_time, Vector3 sphere_location, Quaternion sphere_rotation,
         Quaternion platform_rotation, Quaternion pendulum_rotation, double heading);
     void Render(RenderDevice& render_device);
 
+    // Other robots' spheres to draw around this one, e.g. an ensemble's
+    void UpdateSwarm(const std::vector<RenderDevice::Instance>& robots);
+
 private:
     const double camera_pan_speed = 0.045;
     const double camera_zoom_speed = 0.96;
 
+    const double sphere_radius = 1.0;
+    const double ground_square_size = 2.0;
+    const int ground_extent = 10;
+
+    // a camera touching a surface still picks a finite level of detail
+    const double min_lod_distance = 0.01;
+
     Camera camera;
     Lighting lighting;
 
@@ -34,10 +57,34 @@ private:
     bool relative_camera_orientation;
     bool wireframe_mode;
 
-    Mesh sphere;
-    Mesh platform;
-    Mesh pendulum;
-    Mesh ground;
+    LodChain sphere;
+    RenderMesh platform;
+    RenderMesh pendulum;
+    LodChain ground;
+
+    // the robot's shadow on the ground, from the first light
+    ShadowMap shadow_map;
+
+    // The ground and swarm don't move, so while the view stays put they're
+    // drawn from a layer the render device keeps. Its key is renewed
+    // whenever the view, lights, ground level or swarm change.
+    uint64_t layer_key = 0;
+    uint64_t layer_camera_version = 0;
+    uint64_t layer_lighting_version = 0;
+    const RenderMesh* layer_ground = nullptr;
+    bool swarm_changed = true;
+
+    // whether the robot moved or the drawing mode changed since last drawn
+    bool scene_changed = true;
+
+    // Swarm members, the sphere level each was last drawn at, and the
+    // members drawn at each level
+    std::vector<RenderDevice::Instance> swarm;
+    std::vector<size_t> swarm_levels;
+    std::vector<std::vector<RenderDevice::Instance>> swarm_batches;
 
+    void render_robot(RenderDevice& render_device, const RenderMesh& sphere_mesh);
+    void render_static(RenderDevice& render_device, const RenderMesh& ground_mesh);
+    void render_swarm(RenderDevice& render_device);
     void reset_view();
 };
@@ -0,0 +1,328 @@
+// BB8Bench.cpp : Microbenchmarks for the simulation hot path, printed as JSON.
+//
+// Portable C++17 with no Windows dependencies. Outside Visual Studio it builds with
+//   g++ -O2 -DNDEBUG -std=c++17 -I../BB8 main.cpp ../BB8/{Gearbox,Matrix,Motor,MotorAssembly,Quaternion,Simulation,TorqueCoupling,TorqueInterface,Vector3,Vector4}.cpp
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "Gearbox.h"
+#include "Matrix.h"
+#include "Motor.h"
+#include "MotorAssembly.h"
+#include "Quaternion.h"
+#include "Simulation.h"
+#include "TorqueCoupling.h"
+#include "TorqueInterface.h"
+#include "Vector3.h"
+
+// Keeps the optimizer from discarding a benchmarked result
+template <typename T>
+static void keep(const T& value)
+{
+#ifdef _MSC_VER
+    static const volatile void* sink;
+    sink = &value;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "g"(&value) : "memory");
+#endif
+}
+
+class Benchmark {
+public:
+    std::string name;
+    // performs the operation count times
+    std::function<void(size_t count)> run;
+    // for solvers, the iterations run adds up here, so a solve that stops
+    // iterating shows up in the results
+    std::shared_ptr<size_t> solver_iterations = nullptr;
+};
+
+class Measurement {
+public:
+    std::string name;
+    double min_ns;
+    double median_ns;
+    size_t iterations;
+    size_t samples;
+    // -1 for benchmarks that don't count any
+    double solver_iterations_per_op;
+};
+
+// Grows the batch until one takes min_time, then times samples batches of that size
+static Measurement measure(const Benchmark& benchmark, double min_time, size_t samples)
+{
+    using clock = std::chrono::steady_clock;
+
+    auto time_batch = [&](size_t count) {
+        auto start = clock::now();
+        benchmark.run(count);
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
+    size_t iterations = 1;
+    double elapsed = time_batch(iterations);
+
+    while (elapsed < min_time) {
+        double scale = elapsed > 0.0 ? 1.5 * min_time / elapsed : 10.0;
+        iterations = static_cast<size_t>(iterations * std::min(10.0, std::max(1.5, scale)));
+        elapsed = time_batch(iterations);
+    }
+
+    if (benchmark.solver_iterations) {
+        *benchmark.solver_iterations = 0;
+    }
+
+    std::vector<double> per_op;
+    for (size_t i = 0; i < samples; i++) {
+        per_op.push_back(time_batch(iterations) * 1e9 / iterations);
+    }
+
+    std::sort(per_op.begin(), per_op.end());
+
+    double solver_iterations = benchmark.solver_iterations
+        ? double(*benchmark.solver_iterations) / (double(iterations) * samples)
+        : -1.0;
+
+    return { benchmark.name, per_op.front(), per_op[per_op.size() / 2], iterations, samples, solver_iterations };
+}
+
+// Inputs cycle through a table, so results can't be folded across iterations
+constexpr size_t TABLE_SIZE = 256;
+
+static std::vector<double> random_values(std::mt19937& random, double low, double high)
+{
+    std::uniform_real_distribution<double> distribution(low, high);
+    std::vector<double> values(TABLE_SIZE);
+
+    for (double& value : values) {
+        value = distribution(random);
+    }
+
+    return values;
+}
+
+static std::vector<Quaternion> random_rotations(std::mt19937& random)
+{
+    auto angles = random_values(random, -3.0, 3.0);
+    auto components = random_values(random, -1.0, 1.0);
+
+    std::vector<Quaternion> rotations;
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        Vector3 axis(components[i], components[(i + 1) % TABLE_SIZE], components[(i + 2) % TABLE_SIZE] + 2.0);
+        rotations.push_back(Quaternion::EulerAngle(angles[i], axis));
+    }
+
+    return rotations;
+}
+
+static void add_simulation_benchmarks(std::vector<Benchmark>& benchmarks)
+{
+    // interactive configuration, one update of exactly time_step is one fixed_update
+    struct Method { IntegrationMethod method; const char* name; };
+    const Method methods[] = {
+        { IntegrationMethod::ForwardEuler, "ForwardEuler" },
+        { IntegrationMethod::SemiImplicitEuler, "SemiImplicitEuler" },
+        { IntegrationMethod::RK4, "RK4" },
+        { IntegrationMethod::MultiRate, "MultiRate" },
+    };
+
+    for (const auto& method : methods) {
+        IntegrationMethod integration = method.method;
+
+        benchmarks.push_back({ std::string("Simulation::fixed_update/") + method.name, [integration](size_t count) {
+            constexpr double time_step = 2e-4;
+
+            Simulation simulation(1.0, 9.0, 15.0, 0.7, time_step, Vector3(0.0, 0.0, 1.0));
+            simulation.set_integration(integration);
+
+            for (size_t i = 0; i < count; i++) {
+                simulation.update(time_step);
+            }
+
+            keep(simulation.get_angular_velocity());
+        } });
+    }
+}
+
+static void add_coupling_benchmarks(std::vector<Benchmark>& benchmarks, std::mt19937& random)
+{
+    // a drive motor against a fixed load, like Simulation's drive coupling
+    auto make_assembly = []() { return MotorAssembly(Vex775(), Gearbox(50.0, 1e-2)); };
+
+    // Motors mid-run rather than at rest, where the coupled torque is 0 and
+    // so is the warm start, and a solve would return without iterating
+    auto velocities = random_values(random, -1000.0, 1000.0);
+    auto currents = random_values(random, -10.0, 10.0);
+
+    for (bool affine : { true, false }) {
+        auto loads = random_values(random, 0.5, 2.0);
+        auto solver_iterations = std::make_shared<size_t>(0);
+
+        benchmarks.push_back({ affine ? "TorqueCoupling::solve/closed_form" : "TorqueCoupling::solve/newton",
+            [make_assembly, loads, velocities, currents, affine, solver_iterations](size_t count) {
+            MotorAssembly assembly = make_assembly();
+            double load_inertia = 1.0;
+
+            TorqueInterface load(
+                [&](double torque) { return torque / load_inertia; },
+                [&](double torque) { return 1.0 / load_inertia; },
+                affine);
+            TorqueInterface motor(
+                [&](double torque) { return assembly.acceleration(torque); },
+                [&](double torque) { return assembly.inertia(torque); },
+                affine);
+
+            TorqueCoupling coupling(load, motor);
+
+            for (size_t i = 0; i < count; i++) {
+                load_inertia = loads[i % TABLE_SIZE];
+                double velocity = velocities[i % TABLE_SIZE];
+                assembly.set_state({ { velocity, currents[i % TABLE_SIZE] }, velocity });
+
+                keep(coupling.solve());
+                *solver_iterations += coupling.report().iterations;
+            }
+        }, solver_iterations });
+    }
+
+    auto torques = random_values(random, -5.0, 5.0);
+
+    benchmarks.push_back({ "MotorAssembly::acceleration", [make_assembly, torques](size_t count) {
+        MotorAssembly assembly = make_assembly();
+
+        for (size_t i = 0; i < count; i++) {
+            keep(assembly.acceleration(torques[i % TABLE_SIZE]));
+        }
+    } });
+
+    benchmarks.push_back({ "MotorAssembly::inertia", [make_assembly, torques](size_t count) {
+        MotorAssembly assembly = make_assembly();
+
+        for (size_t i = 0; i < count; i++) {
+            keep(assembly.inertia(torques[i % TABLE_SIZE]));
+        }
+    } });
+}
+
+static void add_math_benchmarks(std::vector<Benchmark>& benchmarks, std::mt19937& random)
+{
+    auto rotations = random_rotations(random);
+    auto components = random_values(random, -10.0, 10.0);
+
+    benchmarks.push_back({ "Quaternion::Multiply", [rotations](size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            keep(rotations[i % TABLE_SIZE].Multiply(rotations[(i + 1) % TABLE_SIZE]));
+        }
+    } });
+
+    benchmarks.push_back({ "Quaternion::Rotate", [rotations, components](size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            Vector3 point(components[i % TABLE_SIZE], components[(i + 1) % TABLE_SIZE], components[(i + 2) % TABLE_SIZE]);
+            keep(rotations[i % TABLE_SIZE].Rotate(point));
+        }
+    } });
+
+    std::vector<Matrix> transforms;
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        Vector3 translation(components[i], components[(i + 1) % TABLE_SIZE], components[(i + 2) % TABLE_SIZE]);
+        transforms.push_back(Matrix::Transformation(rotations[i], translation));
+    }
+
+    benchmarks.push_back({ "Matrix::Multiply", [transforms](size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            keep(Matrix::Multiply(transforms[i % TABLE_SIZE], transforms[(i + 1) % TABLE_SIZE]));
+        }
+    } });
+}
+
+static const char* compiler()
+{
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc";
+#else
+    return "unknown";
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    // BB8Bench [--filter substring] [--min-time seconds] [--samples count]
+    const char* filter = "";
+    double min_time = 0.05;
+    size_t samples = 7;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--filter") == 0) {
+            filter = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--min-time") == 0) {
+            min_time = std::atof(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--samples") == 0) {
+            samples = std::max(1, std::atoi(argv[i + 1]));
+        }
+    }
+
+    // fixed seed, so every build sees the same inputs
+    std::mt19937 random(8);
+    std::vector<Benchmark> benchmarks;
+
+    add_simulation_benchmarks(benchmarks);
+    add_coupling_benchmarks(benchmarks, random);
+    add_math_benchmarks(benchmarks, random);
+
+    std::printf("{\n");
+    std::printf("  \"context\": {\n");
+    std::printf("    \"compiler\": \"%s\",\n", compiler());
+#ifdef NDEBUG
+    std::printf("    \"debug\": false,\n");
+#else
+    std::printf("    \"debug\": true,\n");
+#endif
+    std::printf("    \"min_time\": %g,\n", min_time);
+    std::printf("    \"samples\": %zu\n", samples);
+    std::printf("  },\n");
+    std::printf("  \"benchmarks\": [");
+
+    bool first = true;
+    for (const auto& benchmark : benchmarks) {
+        if (benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        auto result = measure(benchmark, min_time, samples);
+
+        std::printf("%s\n    { \"name\": \"%s\", \"ns_per_op\": %.3f, \"median_ns_per_op\": %.3f, \"iterations\": %zu",
+            first ? "" : ",", result.name.c_str(), result.min_ns, result.median_ns, result.iterations);
+
+        if (result.solver_iterations_per_op >= 0.0) {
+            std::printf(", \"solver_iterations_per_op\": %.3f", result.solver_iterations_per_op);
+        }
+
+        std::printf(" }");
+        std::fflush(stdout);
+
+        first = false;
+    }
+
+    std::printf("\n  ]\n}\n");
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+// BB8Headless.cpp : Runs simulations without a window.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Ensemble.h"
+#include "OfflineRenderer.h"
+#include "Simulation.h"
+#include "SimulationThread.h"
+#include "ThreadPool.h"
+#include "TrajectoryReader.h"
+#include "TrajectoryRecorder.h"
+
+// Records the interactive simulation at its full step rate
+static int record(const char* path, double duration)
+{
+    Simulation simulation(1.0, 9.0, 15.0, 0.7, 2e-4, Vector3(0.0, 0.0, 1.0));
+    TrajectoryRecorder recorder(path);
+
+    if (!recorder.is_open()) {
+        std::fprintf(stderr, "can't open %s\n", path);
+        return 1;
+    }
+
+    // the callback only sees the state after each step, so the first row,
+    // at t = 0, is recorded here
+    recorder.record(simulation, 0.0);
+    simulation.set_step_callback(recorder.callback());
+
+    auto start = std::chrono::steady_clock::now();
+    simulation.update(duration);
+    recorder.close();
+    double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!recorder.ok()) {
+        std::fprintf(stderr, "writing %s failed\n", path);
+        return 1;
+    }
+
+    std::fprintf(stderr, "%zu rows to %s in %.3f s\n", recorder.rows(), path, wall_time);
+    return 0;
+}
+
+// Runs the interactive simulation on its own thread and samples it like the
+// window does, printing each frame's state
+static int realtime(double duration)
+{
+    using clock = std::chrono::steady_clock;
+
+    Simulation simulation(1.0, 9.0, 15.0, 0.7, 2e-4, Vector3(0.0, 0.0, 1.0));
+    SimulationThread simulation_thread(simulation);
+
+    auto frame_duration = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / 60.0));
+    auto start = clock::now();
+    auto next_frame = start;
+
+    std::printf("wall_time,time,x,y,heading\n");
+    simulation_thread.start();
+
+    while (true) {
+        std::this_thread::sleep_until(next_frame);
+        next_frame += frame_duration;
+
+        double wall_time = std::chrono::duration<double>(clock::now() - start).count();
+        const auto& state = simulation_thread.latest();
+
+        std::printf("%.4f,%.4f,%.6f,%.6f,%.6f\n", wall_time, state.time, state.position.X, state.position.Y, state.heading);
+
+        if (wall_time >= duration) {
+            break;
+        }
+    }
+
+    simulation_thread.stop();
+    return 0;
+}
+
+// Renders frames of the interactive simulation, or of a recording, as fast as
+// they can be drawn
+static int render(const char* prefix, ImageFormat format, uint32_t width, uint32_t height,
+    double frame_rate, size_t threads, const char* trajectory_path, double duration, unsigned swarm_size,
+    uint32_t shadow_map_size)
+{
+    OfflineRenderer renderer(width, height, format, prefix, threads, shadow_map_size);
+
+    // A square of resting robots around the origin, with the center left to
+    // the simulated one
+    std::vector<RenderDevice::Instance> swarm;
+    int side = int(std::ceil(std::sqrt(double(swarm_size) + 1.0)));
+
+    for (int i = 0; i < side * side && swarm.size() < swarm_size; i++) {
+        int column = i % side - side / 2;
+        int row = i / side - side / 2;
+
+        if (column != 0 || row != 0) {
+            swarm.push_back({ Quaternion::Identity(), Vector3(3.0 * column, 3.0 * row, 1.0) });
+        }
+    }
+
+    renderer.SetSwarm(swarm);
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (trajectory_path) {
+        TrajectoryReader trajectory(trajectory_path);
+
+        if (!trajectory.is_open()) {
+            std::fprintf(stderr, "can't open %s\n", trajectory_path);
+            return 1;
+        }
+
+        renderer.RenderTrajectory(trajectory, frame_rate);
+    } else {
+        Simulation simulation(1.0, 9.0, 15.0, 0.7, 2e-4, Vector3(0.0, 0.0, 1.0));
+        renderer.RenderSimulation(simulation, duration, frame_rate);
+    }
+
+    double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!renderer.Ok()) {
+        std::fprintf(stderr, "writing frame %zu failed\n", renderer.Frames());
+        return 1;
+    }
+
+    std::fprintf(stderr, "%zu frames in %.3f s, %.1f frames/s\n", renderer.Frames(), wall_time, renderer.Frames() / wall_time);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // BB8Headless [duration] [--batch] [--record path] [--realtime]
+    //     [--render prefix|-] [--format png|ppm|bgra] [--size WxH] [--fps N] [--threads N] [--trajectory path]
+    //     [--swarm N] [--shadow-map N]
+    double duration = 10.0;
+    bool batched = false;
+    bool realtime_mode = false;
+    const char* record_path = nullptr;
+    const char* render_prefix = nullptr;
+    const char* trajectory_path = nullptr;
+    ImageFormat format = ImageFormat::PNG;
+    unsigned width = 800, height = 600;
+    double frame_rate = 60.0;
+    size_t threads = 0;
+    unsigned swarm_size = 0;
+    unsigned shadow_map_size = 1024;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--batch") == 0) {
+            batched = true;
+        } else if (std::strcmp(argv[i], "--realtime") == 0) {
+            realtime_mode = true;
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            render_prefix = argv[++i];
+        } else if (std::strcmp(argv[i], "--trajectory") == 0 && i + 1 < argc) {
+            trajectory_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            format = std::strcmp(name, "ppm") == 0 ? ImageFormat::PPM
+                : std::strcmp(name, "bgra") == 0 ? ImageFormat::BGRA
+                : ImageFormat::PNG;
+        } else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            std::sscanf(argv[++i], "%ux%u", &width, &height);
+        } else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            frame_rate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = size_t(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--swarm") == 0 && i + 1 < argc) {
+            swarm_size = unsigned(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--shadow-map") == 0 && i + 1 < argc) {
+            shadow_map_size = unsigned(std::max(1, std::atoi(argv[++i])));
+        } else {
+            duration = std::atof(argv[i]);
+        }
+    }
+
+    if (render_prefix) {
+        return render(render_prefix, format, width, height, frame_rate, threads, trajectory_path, duration, swarm_size, shadow_map_size);
+    }
+
+    if (record_path) {
+        return record(record_path, duration);
+    }
+
+    if (realtime_mode) {
+        return realtime(duration);
+    }
+
+    // same step size as the interactive simulation
+    Ensemble ensemble(2e-4, duration);
+
+    for (double radius : { 0.8, 1.0, 1.2 }) {
+        for (double sphere_mass : { 6.0, 9.0, 12.0 }) {
+            for (double pendulum_mass : { 10.0, 15.0, 20.0 }) {
+                for (double drive_ratio : { 30.0, 50.0, 70.0 }) {
+                    for (double tilt_ratio : { 20.0, 30.0, 40.0 }) {
+                        ensemble.add({ radius, sphere_mass, pendulum_mass, 0.7 * radius, drive_ratio, tilt_ratio });
+                    }
+                }
+            }
+        }
+    }
+
+    ThreadPool pool;
+    auto results = batched ? ensemble.run_batched(pool) : ensemble.run(pool);
+
+    std::printf("radius,sphere_mass,pendulum_mass,drive_ratio,tilt_ratio,x,y,heading,tilt,angular_velocity,distance,max_tilt_error,stable\n");
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& member = ensemble.members()[i];
+        const auto& result = results[i];
+
+        std::printf("%g,%g,%g,%g,%g,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%d\n",
+            member.radius, member.sphere_mass, member.pendulum_mass, member.drive_ratio, member.tilt_ratio,
+            result.position.X, result.position.Y, result.heading, result.tilt, result.angular_velocity,
+            result.distance, result.max_tilt_error, result.stable ? 1 : 0);
+    }
+
+    auto summary = ensemble.summarize(results);
+    std::fprintf(stderr, "%zu members (%zu unstable) on %zu threads in %.3f s, %.3g steps/s\n",
+        summary.members, summary.unstable, pool.size(), summary.wall_time, summary.steps_per_second);
+    std::fprintf(stderr, "distance mean %.4f min %.4f max %.4f, mean max tilt error %.5f\n",
+        summary.mean_distance, summary.min_distance, summary.max_distance, summary.mean_max_tilt_error);
+
+    return 0;
+}